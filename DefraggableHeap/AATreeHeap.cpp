@@ -0,0 +1,734 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "AATreeHeap.h"
+#include "AlignedAllocator.h"
+
+#include "SIMDMem.h"
+
+#include <cassert>
+#include <new>
+#include <algorithm>
+
+#include <deque>
+
+#include "AATreeHeader.h"
+
+template <typename Policies>
+AATreeHeapEngine<Policies>::AATreeHeapEngine(size_t size, HeaderLayout layout)
+{
+	// Make sure heap size is multiples of 16 bytes
+	static const size_t mask = 16 - 1;
+	const auto offset = ( 16 - ( size & mask ) ) & mask;
+	const auto total_size = size + offset;
+	assert(total_size % 16 == 0);
+
+	// A heap of <64 bytes is undefined
+	assert(total_size >= 64);
+
+	// Get the total number of chunks we need
+	_num_chunks = total_size / 16;
+
+	// Can the total number of chunks be held by the 27 bit free chunk statistic
+	assert(_num_chunks <= (IndexType(-1) >> 5));
+
+	// Allocate the system heap
+	// Out of band headers get their own array so payloads stay contiguous
+	_header_chunks = layout == INLINE_HEADERS ? 1 : 0;
+	_heap = static_cast<AATreeHeader*>(AlignedNew(total_size, 16));
+	_data = _header_chunks ? reinterpret_cast<HeapChunk*>(_heap) 
+		: static_cast<HeapChunk*>(AlignedNew(total_size, 16));
+
+	// Setup the null sentinel node, it sits below every leaf
+	new (&_heap[NULL_INDEX]) AATreeHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED, 0);
+
+	// Setup the root node
+	_root_index = 1;
+	_free_chunks = _num_chunks - 1; // Null, therefore -1
+	new (&_heap[_root_index]) AATreeHeader(NULL_INDEX, NULL_INDEX, _free_chunks, FREE, 1);
+	UpdateNodeStatistics(_heap[_root_index]);
+
+	_rover_index = _root_index;
+
+	// Debug set free chunks in the heap
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), INIT_PATTERN, GetBlockDataChunks(_root_index));
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+AATreeHeapEngine<Policies>::~AATreeHeapEngine()
+{
+	AssertHeapInvariants();
+
+	_pointer_list.RemoveAll();
+
+	// Delete the system heap
+	if (static_cast<void*>(_data) != static_cast<void*>(_heap))
+		AlignedDelete(_data);
+
+	AlignedDelete(_heap);
+}
+
+template <typename Policies>
+void AATreeHeapEngine<Policies>::UpdateNodeStatistics(AATreeHeader &node)
+{
+	// The maximum free contiguous block for the current node
+	// is a 3 way maximum of of children and max of self if we are a free block
+	IndexType max_chunks = std::max<IndexType>(
+		_heap[node._left]._max_contiguous_free_chunks, 
+		_heap[node._right]._max_contiguous_free_chunks);
+
+	if (!node._block_metadata._is_allocated)
+		max_chunks = std::max<IndexType>(max_chunks, node._block_metadata._num_chunks);
+
+	node._max_contiguous_free_chunks = max_chunks;
+}
+
+template <typename Policies>
+void AATreeHeapEngine<Policies>::UpdatePathStatistics(IndexType index)
+{
+	// Record the path down to the block
+	IndexType path[MAX_TREE_DEPTH];
+	IndexType depth = 0;
+	for (auto t = _root_index; t != index; t = index < t ? _heap[t]._left : _heap[t]._right)
+	{
+		assert(t != NULL_INDEX);
+		assert(depth < MAX_TREE_DEPTH);
+		path[depth++] = t;
+	}
+
+	// Update statistics from the block back up to the root
+	UpdateNodeStatistics(_heap[index]);
+	while (depth)
+		UpdateNodeStatistics(_heap[path[--depth]]);
+}
+
+template <typename Policies>
+HeapChunk* AATreeHeapEngine<Policies>::GetBlockData(IndexType index) const
+{
+	return &_data[index + _header_chunks];
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::GetBlockDataChunks(IndexType index) const
+{
+	return _heap[index]._block_metadata._num_chunks - _header_chunks;
+}
+
+template <typename Policies>
+float AATreeHeapEngine<Policies>::FragmentationRatio() const
+{
+	AssertHeapInvariants();
+
+	// Heap is not fragmented if we are at full load
+	if (!_free_chunks)
+		return 0.0f;
+
+	// Get free chunks statistics
+	const auto free = static_cast<float>(_free_chunks);
+	const auto free_max = static_cast<float>(_heap[_root_index]._max_contiguous_free_chunks);
+	
+	// Calculate free chunks ratio to determine fragmentation
+	return (free - free_max) / free;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::Skew( IndexType t )
+{
+	auto &n = _heap[t];
+	const auto l = n._left;
+
+	// Is there a horizontal left link to rotate away
+	if (t == NULL_INDEX || _heap[l]._level != n._level)
+		return t;
+
+	// Rotate the left child up
+	auto &nl = _heap[l];
+	n._left = nl._right;
+	nl._right = t;
+
+	// Update the lowered node then the new parent
+	UpdateNodeStatistics(n);
+	UpdateNodeStatistics(nl);
+
+	return l;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::Split( IndexType t )
+{
+	auto &n = _heap[t];
+	const auto r = n._right;
+
+	// Are there two horizontal right links to rotate away
+	if (t == NULL_INDEX || r == NULL_INDEX || _heap[_heap[r]._right]._level != n._level)
+		return t;
+
+	// Rotate the right child up and raise it a level
+	auto &nr = _heap[r];
+	n._right = nr._left;
+	nr._left = t;
+	nr._level = nr._level + 1;
+
+	// Update the lowered node then the new parent
+	UpdateNodeStatistics(n);
+	UpdateNodeStatistics(nr);
+
+	return r;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::Insert( IndexType t, IndexType index )
+{
+	// Insert new blocks as leaves
+	if (t == NULL_INDEX)
+	{
+		auto &n = _heap[index];
+		n._left = n._right = NULL_INDEX;
+		n._level = 1;
+		UpdateNodeStatistics(n);
+
+		return index;
+	}
+
+	// Block indices are unique so there is never an equal key
+	assert(index != t);
+	if (index < t)
+		_heap[t]._left = Insert(_heap[t]._left, index);
+	else
+		_heap[t]._right = Insert(_heap[t]._right, index);
+
+	UpdateNodeStatistics(_heap[t]);
+
+	// Restore the level invariants on the way back up
+	t = Skew(t);
+	t = Split(t);
+
+	return t;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::Remove( IndexType t, IndexType index )
+{
+	assert(t != NULL_INDEX);
+	auto &n = _heap[t];
+
+	if (index < t)
+		n._left = Remove(n._left, index);
+	else if (index > t)
+		n._right = Remove(n._right, index);
+	else
+	{
+		// A node without a left child is a leaf or has a single leaf as its right child
+		if (n._left == NULL_INDEX)
+			return n._right;
+
+		// Only leaves can be missing a right child
+		assert(n._right != NULL_INDEX);
+
+		// Find the successor of the node
+		auto successor = n._right;
+		while (_heap[successor]._left)
+			successor = _heap[successor]._left;
+
+		// Unlink the successor and put it in the place of the removed node
+		auto &s = _heap[successor];
+		s._right = Remove(n._right, successor);
+		s._left = n._left;
+		s._level = n._level;
+		t = successor;
+	}
+
+	return Rebalance(t);
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::Rebalance( IndexType t )
+{
+	auto &n = _heap[t];
+	UpdateNodeStatistics(n);
+
+	// Does either child sit more than one level below us
+	const IndexType level = n._level;
+	if (_heap[n._left]._level + 1 >= level && _heap[n._right]._level + 1 >= level)
+		return t;
+
+	// Lower the node and its horizontal right sibling
+	n._level = level - 1;
+	if (_heap[n._right]._level > n._level)
+		_heap[n._right]._level = n._level;
+
+	// Rotating inside a subtree does not change its maximum so parents stay valid
+	t = Skew(t);
+	_heap[t]._right = Skew(_heap[t]._right);
+	const auto r = _heap[t]._right;
+	if (r != NULL_INDEX)
+		_heap[r]._right = Skew(_heap[r]._right);
+
+	t = Split(t);
+	_heap[t]._right = Split(_heap[t]._right);
+
+	return t;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const
+{
+	AssertHeapInvariants();
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Traverse down tree until we find a free block large enough
+	while ( t )
+	{
+		auto &n = _heap [ t ];
+
+		// Does the left subtree contain a free block large enough
+		if ( _heap [ n._left ]._max_contiguous_free_chunks >= num_chunks )
+			t = n._left;
+		// Is the current block free and big enough?
+		else if ( !n._block_metadata._is_allocated && n._block_metadata._num_chunks >= num_chunks )
+			break;
+		// The right subtree must contain the free block
+		else
+			t = n._right;
+	}
+	
+	// Return found index
+	return t;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy ) const
+{
+	// Search the blocks after the rover first
+	const auto block = FindFreeBlockAfter(t, _rover_index, num_chunks);
+	if (block)
+		return block;
+
+	// Wrap around to the start of the heap
+	return FindFreeBlock(t, num_chunks, FirstFitPolicy());
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::FindFreeBlockAfter( IndexType t, IndexType start, IndexType num_chunks ) const
+{
+	// Is there even a large enough block in this subtree
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	auto &n = _heap[t];
+
+	// The node and its left subtree are before the start
+	if (t < start)
+		return FindFreeBlockAfter(n._right, start, num_chunks);
+
+	// Try the lower addresses in the left subtree first
+	const auto block = FindFreeBlockAfter(n._left, start, num_chunks);
+	if (block)
+		return block;
+
+	// Is the current block free and big enough?
+	if (!n._block_metadata._is_allocated && n._block_metadata._num_chunks >= num_chunks)
+		return t;
+
+	// Every block in the right subtree is after the start
+	if (_heap[n._right]._max_contiguous_free_chunks >= num_chunks)
+		return FindFreeBlock(n._right, num_chunks, FirstFitPolicy());
+
+	return NULL_INDEX;
+}
+
+template <typename Policies>
+IndexType AATreeHeapEngine<Policies>::FindPreviousBlock( IndexType index ) const
+{
+	// The previous block is the largest key less than the block
+	IndexType previous = NULL_INDEX;
+	for (auto t = _root_index; t; )
+	{
+		if (t < index)
+		{
+			previous = t;
+			t = _heap[t]._right;
+		}
+		else
+			t = _heap[t]._left;
+	}
+
+	return previous;
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock AATreeHeapEngine<Policies>::Allocate(size_t num_bytes)
+{
+	AssertHeapInvariants();
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunks(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock AATreeHeapEngine<Policies>::AllocateChunks(IndexType required_chunks)
+{
+	assert(required_chunks);
+
+	// Do we have enough contiguous space for the allocation
+	if (_heap[_root_index]._max_contiguous_free_chunks < required_chunks)
+		return nullptr;
+
+	const auto free_block = FindFreeBlock(_root_index, required_chunks, FitPolicy());
+	assert(free_block);
+
+	/* Split the free block into two, one allocated block and one free block */
+
+	// Calculate the new raw free block size
+	const auto raw_free_chunks = _heap[free_block]._block_metadata._num_chunks
+		- required_chunks;
+
+	// Set the found block so that it represents a now allocated block
+	_heap[free_block]._block_metadata = { ALLOCATED, required_chunks };
+	_free_chunks -= required_chunks;
+
+	// Continue searching from after this allocation
+	if (FitPolicy::ROVING)
+		_rover_index = free_block + required_chunks;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(free_block), ALLOC_PATTERN, GetBlockDataChunks(free_block));
+
+	// Is there a new free block to add to the tree
+	if (raw_free_chunks)
+	{
+		const auto new_free_index = free_block + required_chunks;
+		new (&_heap[new_free_index]) AATreeHeader(NULL_INDEX, NULL_INDEX, raw_free_chunks, FREE, 1);
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_free_index), SPLIT_PATTERN, GetBlockDataChunks(new_free_index));
+
+		// The new block directly follows the allocated block so the insertion path passes
+		// through it, updating its statistics along with every ancestor
+		_root_index = Insert(_root_index, new_free_index);
+	}
+	else
+		UpdatePathStatistics(free_block);
+
+	AssertHeapInvariants();
+
+	return _pointer_list.Create(GetBlockData(free_block));
+}
+
+template <typename Policies>
+void AATreeHeapEngine<Policies>::Free(DefraggablePointerControlBlock& ptr)
+{
+	AssertHeapInvariants();
+	void* data = ptr.Get();
+
+	// We cannot free the null pointer
+	if (!data)
+		return;
+
+	// Get the offset of the pointer into the heap
+	const auto block_addr = static_cast<HeapChunk*>(data);
+	const std::ptrdiff_t offset = block_addr - _data;
+
+	// Is the offset in a valid range
+	if ( offset <= ptrdiff_t( _header_chunks ) || offset >= ptrdiff_t( _num_chunks ) )
+		return;
+
+	// Is the data pointer of expected alignment
+	if (block_addr != &_data[offset])
+		return;
+
+	// Mark the block as being free
+	auto block = IndexType(offset) - _header_chunks;
+	assert(_heap[block]._block_metadata._is_allocated);
+	_heap[block]._block_metadata._is_allocated = FREE;
+	_free_chunks += _heap[block]._block_metadata._num_chunks;
+
+	// Invalidate defraggable pointers that point into the block before we invalidate data in the heap
+	if (PointerPolicy::INVALIDATE_ALIASES)
+		_pointer_list.RemovePointersInRange(&_data[block], &_data[block + _heap[block]._block_metadata._num_chunks]);
+	else
+		ptr = nullptr;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(block), FREED_PATTERN, GetBlockDataChunks(block));
+
+	// We may have invalidated our invariant of having no two free adjacent blocks
+	// Collapse adjacent free blocks in the heap to restore the invariant
+	// The next block directly follows us in the heap
+	const auto next = block + _heap[block]._block_metadata._num_chunks;
+	if (next < _num_chunks && !_heap[next]._block_metadata._is_allocated)
+	{
+		_root_index = Remove(_root_index, next);
+		_heap[block]._block_metadata._num_chunks += _heap[next]._block_metadata._num_chunks;
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(block), MERGE_PATTERN, GetBlockDataChunks(block));
+	}
+
+	// The previous block is our predecessor in the tree
+	const auto previous = FindPreviousBlock(block);
+	if (!_heap[previous]._block_metadata._is_allocated)
+	{
+		_root_index = Remove(_root_index, block);
+		_heap[previous]._block_metadata._num_chunks += _heap[block]._block_metadata._num_chunks;
+		block = previous;
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(block), MERGE_PATTERN, GetBlockDataChunks(block));
+	}
+
+	// Update the statistics of the merged block and its ancestors
+	UpdatePathStatistics(block);
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+void AATreeHeapEngine<Policies>::FullDefrag()
+{
+	AssertHeapInvariants();
+	while (!IterateHeap())
+		;
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+bool AATreeHeapEngine<Policies>::IsFullyDefragmented() const
+{
+	AssertHeapInvariants();
+	return _heap[_root_index]._max_contiguous_free_chunks == _free_chunks;
+}
+
+template <typename Policies>
+bool AATreeHeapEngine<Policies>::IterateHeap()
+{
+	AssertHeapInvariants();
+	// Do we actually need to defrag the heap
+	if (IsFullyDefragmented())
+		return true;
+
+	// Find the first free block in the heap
+	const auto free_block = FindFreeBlock(_root_index, 1, FirstFitPolicy());
+	const auto free_chunks = _heap[free_block]._block_metadata._num_chunks;
+
+	// Our heap invariant means the next block must be allocated
+	const auto right = free_block + free_chunks;
+	assert(right < _num_chunks);
+	assert(_heap[right]._block_metadata._is_allocated);
+	const auto moved_chunks = _heap[right]._block_metadata._num_chunks;
+
+	// Update defraggable pointers before invalidating the heap
+	_pointer_list.OffsetPointersInRange(&_data[right], &_data[right + moved_chunks], (ptrdiff_t(free_block) - ptrdiff_t(right)) * 16);
+
+	// The moved block takes over the node of the free block, the free block moves past it
+	_root_index = Remove(_root_index, right);
+
+	// Absorb the free block after the moved block, if there is one
+	auto new_free_chunks = free_chunks;
+	const auto next = right + moved_chunks;
+	if (next < _num_chunks && !_heap[next]._block_metadata._is_allocated)
+	{
+		new_free_chunks += _heap[next]._block_metadata._num_chunks;
+		_root_index = Remove(_root_index, next);
+	}
+
+	/* CONSIDER THE HEAP INVALID FROM HERE */
+
+	// Mark the free block node as allocated and move the data
+	_heap[free_block]._block_metadata = { ALLOCATED, moved_chunks };
+	SIMDMemCopy(GetBlockData(free_block), &_data[right + _header_chunks], moved_chunks - _header_chunks);
+
+	// Create new free block header
+	const auto new_free_index = free_block + moved_chunks;
+	new (&_heap[new_free_index]) AATreeHeader(NULL_INDEX, NULL_INDEX, new_free_chunks, FREE, 1);
+
+	/* HEAP IS NOW VALID */
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(new_free_index), MOVE_PATTERN, GetBlockDataChunks(new_free_index));
+
+	// The new free block directly follows the moved block so the insertion path passes
+	// through it, updating its statistics along with every ancestor
+	_root_index = Insert(_root_index, new_free_index);
+
+	AssertHeapInvariants();
+
+	return IsFullyDefragmented( );
+}
+
+template <typename Policies>
+void AATreeHeapEngine<Policies>::AssertHeapInvariants() const
+{
+#ifdef NDEBUG
+	// We don't want to call this in release code
+	return;
+#endif
+
+	// The debug policy may opt out of invariant checking
+	if (!DebugPolicy::CHECK_INVARIANTS)
+		return;
+
+	/**
+	*	AA tree heap uses a null sentinel node at level 0 to simplify some heap operations.
+	*/
+	{
+		// Assert that the first block is the null node, is allocated and is one chunk large
+		assert(_heap[NULL_INDEX]._left == NULL_INDEX);
+		assert(_heap[NULL_INDEX]._right == NULL_INDEX);
+		assert(_heap[NULL_INDEX]._block_metadata._is_allocated);
+		assert(_heap[NULL_INDEX]._block_metadata._num_chunks == 1);
+		assert(_heap[NULL_INDEX]._max_contiguous_free_chunks == 0);
+		assert(_heap[NULL_INDEX]._level == 0);
+	}
+
+	/**
+	*	AA tree heap uses block sizes to track position in the heap. The sum of all the metadata block sizes should be the raw size of the heap.
+	*/
+	{
+		IndexType size = 0;
+		while (size < _num_chunks)
+		{
+			// Add block size to sum
+			size += _heap[size]._block_metadata._num_chunks;
+		}
+
+		// Assert size invariant
+		assert(size == _num_chunks);
+	}
+
+	/**
+	*	AA tree heap follows the defraggable heap property that there are no two contiguous blocks free blocks.
+	*/
+	{
+		IndexType prev = 0;
+		IndexType current = 1;
+		while (current < _num_chunks)
+		{
+			// Asert invariant
+			if (!_heap[current]._block_metadata._is_allocated)
+			{
+				assert(_heap[prev]._block_metadata._is_allocated);
+			}
+
+			// Go to next block
+			prev = current;
+			current += _heap[current]._block_metadata._num_chunks;
+		}
+	}
+
+	/**
+	*	AA tree heap tracks the total number of free chunks in the heap. This should be the sum of all the free block sizes.
+	*/
+	{
+		IndexType size = 0;
+		IndexType index = 0;
+		while (index < _num_chunks)
+		{
+			// Add block size to sum
+			if (!_heap[index]._block_metadata._is_allocated)
+				size += _heap[index]._block_metadata._num_chunks;
+
+			index += _heap[index]._block_metadata._num_chunks;
+		}
+
+		// Assert size invariant
+		assert(size == _free_chunks);
+	}
+
+	/**
+	*	AA tree heap uses a tree structure to manage blocks. An inorder traversal should match the heap structure exactly.
+	*	Every node must satisfy the AA tree level invariants and hold the maximum free block of its subtree.
+	*/
+	{
+		std::deque<IndexType> tree;
+		IndexType node = _root_index;
+		IndexType current = 1;
+
+		// Perform inorder traversal 
+		while (node || !tree.empty())
+		{
+			if (node)
+			{
+				tree.push_back(node);
+				node = _heap[node]._left;
+				continue;
+			}
+
+			// Visit last node on stack
+			node = tree.back();
+			tree.pop_back();
+
+			// Assert that the current positions match in the heap
+			assert(current == node);
+			current += _heap[current]._block_metadata._num_chunks;
+
+			const auto &n = _heap[node];
+			const auto &l = _heap[n._left];
+			const auto &r = _heap[n._right];
+
+			// Leaves are at level 1, left children are one level down, right children at most one level down
+			assert(n._level >= 1);
+			assert(n._left || n._right || n._level == 1);
+			assert(l._level + 1 == n._level);
+			assert(r._level == n._level || r._level + 1 == n._level);
+
+			// There are never two horizontal right links in a row
+			assert(_heap[r._right]._level < n._level);
+
+			// Assert the cached maximum matches the children
+			IndexType max_chunks = std::max<IndexType>(l._max_contiguous_free_chunks, r._max_contiguous_free_chunks);
+			if (!n._block_metadata._is_allocated)
+				max_chunks = std::max<IndexType>(max_chunks, n._block_metadata._num_chunks);
+			assert(max_chunks == n._max_contiguous_free_chunks);
+
+			// Advance down right subtree
+			node = n._right;
+		}
+
+		// The tree covers the whole heap
+		assert(current == _num_chunks);
+	}
+}
+
+// Instantiate the engine for the supported policy combinations
+// Best fit needs a size index the AA tree does not keep within its worst case bounds
+INSTANTIATE_HEAP_ENGINE_FOR_FIT(AATreeHeapEngine, FirstFitPolicy)
+INSTANTIATE_HEAP_ENGINE_FOR_FIT(AATreeHeapEngine, NextFitPolicy)
\ No newline at end of file
@@ -0,0 +1,267 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "BasicDefraggableHeap.h"
+#include "DefraggablePointerList.h"
+#include "HeapCommon.h"
+#include "HeapPolicies.h"
+
+struct AATreeHeader;
+
+/**
+*	A defraggable heap engine implemented as an AA tree. 
+*	Unlike the splay tree engine every operation is worst case logarithmic in the number of blocks.
+*
+*	@tparam Policies the HeapPolicies bundle the engine is compiled for
+*/
+template <typename Policies>
+class AATreeHeapEngine
+{
+
+public:
+
+	typedef typename Policies::FitPolicy FitPolicy;
+	typedef typename Policies::PointerPolicy PointerPolicy;
+	typedef typename Policies::DebugPolicy DebugPolicy;
+
+	/**
+	*	Constructs an AA tree heap.
+	*
+	*	@param size the size of the heap in bytes.
+	*	@param layout where the block headers should be stored
+	*/
+	AATreeHeapEngine(size_t size, HeaderLayout layout = INLINE_HEADERS);
+
+	/**
+	*	Destroys an AA tree heap.
+	*/
+	~AATreeHeapEngine();
+
+	/**
+	*	Allocates from the AA tree heap. Always 16 byte aligned.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes);
+
+	/**
+	*	Frees the given heap data. Invalidates all defraggable pointers
+	*	pointing into the free block, or only the given pointer if the 
+	*	pointer policy does not track aliases.
+	*
+	*	@param ptr pointer into block in heap to free
+	*/
+	void Free(DefraggablePointerControlBlock &ptr);
+
+	/**
+	*	Fully Defragments the heap.
+	*/
+	void FullDefrag();
+
+	/**
+	*	Iterates the defragmentation process on the heap.
+	*	Heap is still valid for use after a call to this method. 
+	*
+	*	@returns true if the heap is now fully defragmented
+	*/
+	bool IterateHeap();
+
+	/**
+	*	Gets the fragmentation ratio of the heap.
+	*
+	*	@returns 0 if no fragmentation, 1 if fully fragmented
+	*/
+	float FragmentationRatio() const;
+
+	/**
+	*	Gets if the heap is fully defragmented.
+	*
+	*	@returns true if fully defragmented, false if there is fragmentation
+	*/
+	bool IsFullyDefragmented() const;
+
+protected:
+
+	/**
+	*	Allocates a block of the given number of chunks, including the header.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunks(IndexType required_chunks);
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size.
+	*
+	*	@param t the node to start the search at
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const;
+
+	/**
+	*	Finds the first free heap block of desired size after the rover, wrapping around
+	*	to the start of the heap.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy ) const;
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size at or after the given index.
+	*
+	*	@param t the node to start the search at
+	*	@param start the lowest block index the search accepts
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlockAfter( IndexType t, IndexType start, IndexType num_chunks ) const;
+
+	/**
+	*	Finds the block directly preceding the given block in the heap.
+	*
+	*	@param index the index of the block
+	*	@returns the previous block, the null index if the block is the first block
+	*/
+	IndexType FindPreviousBlock( IndexType index ) const;
+
+	/**
+	*	Inserts the given block into the tree.
+	*
+	*	@param t the root of the subtree to insert into
+	*	@param index the index of the block to insert
+	*	@returns the new root of the subtree
+	*/
+	IndexType Insert( IndexType t, IndexType index );
+
+	/**
+	*	Removes the given block from the tree.
+	*
+	*	@param t the root of the subtree to remove from
+	*	@param index the index of the block to remove
+	*	@returns the new root of the subtree
+	*/
+	IndexType Remove( IndexType t, IndexType index );
+
+	/**
+	*	Restores the level invariants of a node after a removal below it.
+	*
+	*	@param t the node to rebalance
+	*	@returns the new root of the subtree
+	*/
+	IndexType Rebalance( IndexType t );
+
+	/**
+	*	Rotates away a horizontal left link.
+	*
+	*	@param t the node to skew
+	*	@returns the new root of the subtree
+	*/
+	IndexType Skew( IndexType t );
+
+	/**
+	*	Rotates away two consecutive horizontal right links, raising the middle node a level.
+	*
+	*	@param t the node to split
+	*	@returns the new root of the subtree
+	*/
+	IndexType Split( IndexType t );
+
+	/**
+	*	Updates the node statistics of every node on the path from the root to the given block.
+	*
+	*	@param index the index of the block that changed
+	*/
+	void UpdatePathStatistics( IndexType index );
+
+	/**
+	*	Updates the node statistics of a given node.
+	*
+	*	@param node the node to update the statistics for
+	*/
+	void UpdateNodeStatistics( AATreeHeader &node );
+
+	/**
+	*	Gets the payload address of the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the address of the first payload chunk
+	*/
+	HeapChunk* GetBlockData(IndexType index) const;
+
+	/**
+	*	Gets the number of payload chunks in the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the number of chunks not used by the block header
+	*/
+	IndexType GetBlockDataChunks(IndexType index) const;
+
+	/**
+	*	Asserts invariants over the heap.
+	*/
+	void AssertHeapInvariants() const;
+
+	/**< The block headers we manage, indexed by chunk. */
+	AATreeHeader* _heap;
+
+	/**< The payload chunks we manage. Aliases the headers when they are stored inline. */
+	HeapChunk* _data;
+
+	/**< The number of chunks each block spends on its header. */
+	IndexType _header_chunks;
+
+	/**< The number of chunks in the heap. */
+	IndexType _num_chunks;
+
+	/**< The root of the AA tree. */
+	IndexType _root_index;
+
+	/**< The total number of free chunks in the heap. */
+	IndexType _free_chunks;
+
+	/**< The end of the last allocation, where roving fit policies start searching. */
+	IndexType _rover_index;
+
+	/**< The list of defraggable pointers for this heap. */
+	DefraggablePointerList _pointer_list;
+
+	/**< The offset of the null sentinel node into the heap. */
+	static const IndexType NULL_INDEX = 0;
+
+	/**< The deepest path an AA tree over 2^27 chunks can have. */
+	static const IndexType MAX_TREE_DEPTH = 64;
+};
+
+/**
+*	A defraggable heap implemented as an AA tree with the default policies.
+*/
+typedef BasicDefraggableHeap<AATreeHeapEngine> AATreeHeap;
\ No newline at end of file
@@ -0,0 +1,173 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "DefraggablePointerControlBlock.h"
+#include "HeapCommon.h"
+#include "HeapPolicies.h"
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+
+/**
+*	A defraggable heap assembled from a block management engine and a set of compile time policies.
+*	Features a policy does not use are compiled out of the engine hot paths.
+*
+*	@tparam Engine the block management engine, parameterized on a HeapPolicies bundle
+*	@tparam FitPolicy the policy used to pick a free block for an allocation
+*	@tparam PointerPolicy the policy used to track defraggable pointers
+*	@tparam DebugPolicy the policy used for debug fills and invariant checks
+*/
+template <template <typename> class Engine, 
+	typename FitPolicy = FirstFitPolicy, 
+	typename PointerPolicy = SharedPointerPolicy, 
+	typename DebugPolicy = DefaultDebugPolicy>
+class BasicDefraggableHeap final : public Engine<HeapPolicies<FitPolicy, PointerPolicy, DebugPolicy>>
+{
+
+public:
+
+	/**< The engine type backing this heap. */
+	typedef Engine<HeapPolicies<FitPolicy, PointerPolicy, DebugPolicy>> EngineType;
+
+	/**
+	*	Constructs a defraggable heap, forwarding the arguments to the engine.
+	*
+	*	@param args the engine constructor arguments
+	*/
+	template <typename... Args>
+	explicit BasicDefraggableHeap(Args&&... args)
+		: EngineType(std::forward<Args>(args)...), _auto_defragging(false)
+	{
+
+	}
+
+	/**
+	*	Allocates from the heap. Always 16 byte aligned.
+	*	Does a slice of defragmentation afterwards if the auto defrag policy calls for it.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes)
+	{
+		auto ptr = EngineType::Allocate(num_bytes);
+		AutoDefrag();
+		return ptr;
+	}
+
+	/**
+	*	Allocates from the heap, placing the block by how long it is expected to live. Always 16 byte aligned.
+	*	Does a slice of defragmentation afterwards if the auto defrag policy calls for it.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@param hint how long the block is expected to live
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes, LifetimeHint hint)
+	{
+		auto ptr = EngineType::Allocate(num_bytes, hint);
+		AutoDefrag();
+		return ptr;
+	}
+
+	/**
+	*	Allocates a compile time known number of bytes from the heap. Always 16 byte aligned.
+	*
+	*	@tparam NumBytes the number of bytes to allocate
+	*	@returns the pointer to allocated memory
+	*/
+	template <size_t NumBytes>
+	DefraggablePointerControlBlock Allocate()
+	{
+		static_assert(NumBytes > 0, "An allocation of 0 bytes is redundant.");
+
+		// Calculate the number of payload chunks required to fulfil the request
+		constexpr IndexType payload_chunks = IndexType((NumBytes + 15) / 16);
+
+		auto ptr = this->AllocateChunks(payload_chunks + this->_header_chunks);
+		AutoDefrag();
+		return ptr;
+	}
+
+	/**
+	*	Frees the given heap data, see the engine for which pointers are invalidated.
+	*	Does a slice of defragmentation afterwards if the auto defrag policy calls for it.
+	*
+	*	@param ptr pointer into block in heap to free
+	*/
+	void Free(DefraggablePointerControlBlock &ptr)
+	{
+		EngineType::Free(ptr);
+		AutoDefrag();
+	}
+
+	/**
+	*	Sets when the heap defragments itself at the end of Allocate and Free.
+	*
+	*	@param policy the thresholds and budget to defragment with
+	*/
+	void SetAutoDefragPolicy(const AutoDefragPolicy &policy)
+	{
+		assert(policy._stop_ratio <= policy._start_ratio);
+		_auto_defrag_policy = policy;
+		_auto_defragging = false;
+	}
+
+private:
+
+	/**
+	*	Does a slice of defragmentation within the policy budget if the heap is, or still is, too fragmented.
+	*/
+	void AutoDefrag()
+	{
+		if (!_auto_defrag_policy._budget)
+			return;
+
+		// Start defragmenting once the heap is too fragmented, then carry on until it is well below that
+		if (!_auto_defragging)
+		{
+			if (this->FragmentationRatio() <= _auto_defrag_policy._start_ratio)
+				return;
+
+			_auto_defragging = true;
+		}
+
+		bool done = false;
+		for (size_t i = 0; i < _auto_defrag_policy._budget && !done; ++i)
+			done = this->IterateHeap();
+
+		_auto_defragging = !done && this->FragmentationRatio() > _auto_defrag_policy._stop_ratio;
+	}
+
+	/**< When the heap defragments itself. */
+	AutoDefragPolicy _auto_defrag_policy;
+
+	/**< Is the heap defragmenting itself until it falls to the stop ratio. */
+	bool _auto_defragging;
+};
\ No newline at end of file
@@ -0,0 +1,631 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "BitmapHeap.h"
+#include "AlignedAllocator.h"
+
+#include "SIMDMem.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include <intrin.h>
+
+template <typename Policies>
+BitmapHeapEngine<Policies>::BitmapHeapEngine(size_t size)
+{
+	// Make sure heap size is multiples of 16 bytes
+	static const size_t mask = 16 - 1;
+	const auto offset = (16 - (size & mask)) & mask;
+	const auto total_size = size + offset;
+	assert(total_size % 16 == 0);
+
+	// A heap of <64 bytes is undefined
+	assert(total_size >= 64);
+
+	// Get the total number of chunks we need
+	_num_chunks = total_size / 16;
+
+	// Can the total number of chunks be indexed bu a 31 bit unsigned integer.
+	assert(_num_chunks <= (IndexType(-1) >> 1));
+
+	// Allocate the system heap, block sizes live in the bitmaps so payloads are fully contiguous
+	_header_chunks = 0;
+	_data = static_cast<HeapChunk*>(AlignedNew(total_size, 16));
+
+	// Allocate the bitmaps with at least one bit past the heap, it marks where the last block ends
+	_num_words = _num_chunks / 64 + 1;
+	_used_bits = static_cast<uint64_t*>(AlignedNew(_num_words * sizeof(uint64_t), 16));
+	_start_bits = static_cast<uint64_t*>(AlignedNew(_num_words * sizeof(uint64_t), 16));
+	memset(_used_bits, 0, _num_words * sizeof(uint64_t));
+	memset(_start_bits, 0, _num_words * sizeof(uint64_t));
+
+	// Allocate the summaries of the used bitmap, one bit per word
+	_num_summary_words = _num_words / 64 + 1;
+	_free_words = static_cast<uint64_t*>(AlignedNew(_num_summary_words * sizeof(uint64_t), 16));
+	_used_words = static_cast<uint64_t*>(AlignedNew(_num_summary_words * sizeof(uint64_t), 16));
+	memset(_free_words, 0, _num_summary_words * sizeof(uint64_t));
+	memset(_used_words, 0, _num_summary_words * sizeof(uint64_t));
+	UpdateSummaries(0, _num_words);
+
+	// The bits past the heap look like one allocated block so scans stop at the end of the heap
+	SetUsedBits(_num_chunks, _num_words * 64 - _num_chunks, true);
+	SetBits(_start_bits, _num_chunks, 1, true);
+
+	// Setup the null sentinel block
+	SetUsedBits(NULL_INDEX, 1, true);
+	SetBits(_start_bits, NULL_INDEX, 1, true);
+
+	// Setup heap tracking state
+	_free_chunks = _num_chunks - 1; // Null, therefore -1
+	_first_free_chunk = 1;
+	_max_run_chunks = _free_chunks;
+
+	// Debug set free chunks in the heap
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(&_data[_first_free_chunk], INIT_PATTERN, _free_chunks);
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+BitmapHeapEngine<Policies>::~BitmapHeapEngine()
+{
+	AssertHeapInvariants();
+
+	_pointer_list.RemoveAll();
+
+	// Delete the system heap and bitmaps
+	AlignedDelete(_used_words);
+	AlignedDelete(_free_words);
+	AlignedDelete(_start_bits);
+	AlignedDelete(_used_bits);
+	AlignedDelete(_data);
+}
+
+template <typename Policies>
+template <typename WordFunction>
+IndexType BitmapHeapEngine<Policies>::FindSetBit(IndexType from, IndexType to, const uint64_t *summary, WordFunction word) const
+{
+	assert(to <= _num_words * 64);
+
+	if (from >= to)
+		return to;
+
+	// Ignore the bits before the start in the first word
+	IndexType w = from / 64;
+	const IndexType last = (to - 1) / 64;
+	uint64_t bits = word(w) & (~uint64_t(0) << (from % 64));
+
+	// Skip whole words until one has a set bit, the summary skips 64 words at a time
+	while (!bits)
+	{
+		w = summary ? FindSummaryBit(summary, w + 1, last) : w + 1;
+		if (w > last)
+			return to;
+
+		bits = word(w);
+	}
+
+	unsigned long bit;
+	_BitScanForward64(&bit, bits);
+
+	return std::min(w * 64 + IndexType(bit), to);
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::FindSummaryBit(const uint64_t *summary, IndexType from, IndexType last) const
+{
+	if (from > last)
+		return from;
+
+	// Ignore the words before the start in the first summary word
+	IndexType sw = from / 64;
+	const IndexType last_sw = last / 64;
+	uint64_t bits = summary[sw] & (~uint64_t(0) << (from % 64));
+
+	while (!bits)
+	{
+		if (++sw > last_sw)
+			return last + 1;
+
+		bits = summary[sw];
+	}
+
+	unsigned long bit;
+	_BitScanForward64(&bit, bits);
+
+	return sw * 64 + IndexType(bit);
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::FindLastUsedChunk(IndexType before) const
+{
+	assert(before > NULL_INDEX && before <= _num_chunks);
+
+	// Ignore the bits at and after the end in the last word
+	IndexType w = (before - 1) / 64;
+	uint64_t bits = _used_bits[w] & (~uint64_t(0) >> (63 - (before - 1) % 64));
+
+	// The null sentinel is always allocated, so the scan stops at the start of the heap
+	while (!bits)
+	{
+		// Skip back to the previous word with an allocated chunk in the summary
+		IndexType sw = (w - 1) / 64;
+		uint64_t summary = _used_words[sw] & (~uint64_t(0) >> (63 - (w - 1) % 64));
+
+		while (!summary)
+			summary = _used_words[--sw];
+
+		unsigned long bit;
+		_BitScanReverse64(&bit, summary);
+
+		w = sw * 64 + IndexType(bit);
+		bits = _used_bits[w];
+	}
+
+	unsigned long bit;
+	_BitScanReverse64(&bit, bits);
+
+	return w * 64 + IndexType(bit);
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::GetFreeRunChunks(IndexType index) const
+{
+	assert(!((_used_bits[index / 64] >> (index % 64)) & 1));
+
+	// The run extends back to the previous allocated chunk and forward to the next one
+	const auto first = FindLastUsedChunk(index) + 1;
+	const auto end = FindSetBit(index, _num_chunks, _used_words, [this](IndexType w) { return _used_bits[w]; });
+
+	return end - first;
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::FindFreeChunk(IndexType from) const
+{
+	return FindSetBit(from, _num_chunks, _free_words, [this](IndexType w) { return ~_used_bits[w]; });
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::FindBlock(IndexType from) const
+{
+	// Start bits are a subset of the used bits, so the first allocated chunk after a free chunk or the end of a block is a block start
+	const auto index = FindSetBit(from, _num_chunks, _used_words, [this](IndexType w) { return _used_bits[w]; });
+	assert(index == _num_chunks || ((_start_bits[index / 64] >> (index % 64)) & 1));
+
+	return index;
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::GetBlockChunks(IndexType index) const
+{
+	assert((_start_bits[index / 64] >> (index % 64)) & 1);
+
+	// The block ends where another block starts or a free run starts
+	const auto end = FindSetBit(index + 1, _num_chunks, nullptr, [this](IndexType w) { return _start_bits[w] | ~_used_bits[w]; });
+	assert(end <= _num_chunks);
+
+	return end - index;
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::SetBits(uint64_t *bits, IndexType first, IndexType count, bool value)
+{
+	if (!count)
+		return;
+
+	// Mask the partial words at either end of the range
+	const auto first_word = first / 64;
+	const auto last_word = (first + count - 1) / 64;
+	auto first_mask = ~uint64_t(0) << (first % 64);
+	const auto last_mask = ~uint64_t(0) >> (63 - (first + count - 1) % 64);
+
+	if (first_word == last_word)
+		first_mask &= last_mask;
+
+	if (value)
+		bits[first_word] |= first_mask;
+	else
+		bits[first_word] &= ~first_mask;
+
+	if (first_word == last_word)
+		return;
+
+	// The words in between are filled whole
+	std::fill(bits + first_word + 1, bits + last_word, value ? ~uint64_t(0) : uint64_t(0));
+
+	if (value)
+		bits[last_word] |= last_mask;
+	else
+		bits[last_word] &= ~last_mask;
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::SetUsedBits(IndexType first, IndexType count, bool value)
+{
+	if (!count)
+		return;
+
+	SetBits(_used_bits, first, count, value);
+
+	// The words wholly inside the range are now all allocated or all free
+	const auto first_word = first / 64;
+	const auto last_word = (first + count - 1) / 64;
+	if (last_word > first_word + 1)
+	{
+		SetBits(_free_words, first_word + 1, last_word - first_word - 1, !value);
+		SetBits(_used_words, first_word + 1, last_word - first_word - 1, value);
+	}
+
+	// The partial words at either end are recomputed
+	UpdateSummaries(first_word, first_word + 1);
+	UpdateSummaries(last_word, last_word + 1);
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::UpdateSummaries(IndexType first_word, IndexType end_word)
+{
+	for (auto w = first_word; w < end_word; ++w)
+	{
+		SetBits(_free_words, w, 1, _used_bits[w] != ~uint64_t(0));
+		SetBits(_used_words, w, 1, _used_bits[w] != 0);
+	}
+}
+
+template <typename Policies>
+float BitmapHeapEngine<Policies>::FragmentationRatio() const
+{
+	AssertHeapInvariants();
+
+	// Heap is not fragmented if we are at full load
+	if (!_free_chunks)
+		return 0.0f;
+
+	// Get free chunks statistics by walking the free runs
+	IndexType max_contiguous_free_chunks = 0;
+	IndexType index = _first_free_chunk;
+
+	while (index < _num_chunks)
+	{
+		const auto end = FindSetBit(index, _num_chunks, _used_words, [this](IndexType w) { return _used_bits[w]; });
+		max_contiguous_free_chunks = std::max(max_contiguous_free_chunks, end - index);
+
+		index = FindFreeChunk(end);
+	}
+
+	const auto free_max = static_cast<float>(max_contiguous_free_chunks);
+	const auto free = static_cast<float>(_free_chunks);
+
+	// Calculate free chunks ratio to determine fragmentation
+	return (free - free_max) / free;
+}
+
+template <typename Policies>
+bool BitmapHeapEngine<Policies>::IsFullyDefragmented() const
+{
+	AssertHeapInvariants();
+
+	// The heap is fully defragmented if every allocated chunk is below the first free chunk
+	return _first_free_chunk == _num_chunks - _free_chunks;
+}
+
+template <typename Policies>
+IndexType BitmapHeapEngine<Policies>::FindFreeRun(IndexType num_chunks) const
+{
+	// Is there even enough space in the heap to make an allocation, or a free run that could be big enough
+	if (_free_chunks < num_chunks || _max_run_chunks < num_chunks)
+		return _num_chunks;
+
+	// Walk the free runs in address order
+	IndexType index = _first_free_chunk;
+	while (index < _num_chunks)
+	{
+		// Only the first bits of a run need scanning to know the allocation fits, the wilderness is never walked
+		const auto end = FindSetBit(index, std::min(index + num_chunks, _num_chunks), _used_words, [this](IndexType w) { return _used_bits[w]; });
+		if (end - index >= num_chunks)
+			return index;
+
+		index = FindFreeChunk(end);
+	}
+
+	return _num_chunks;
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock BitmapHeapEngine<Policies>::Allocate(size_t num_bytes)
+{
+	AssertHeapInvariants();
+
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunks(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock BitmapHeapEngine<Policies>::AllocateChunks(IndexType required_chunks)
+{
+	assert(required_chunks);
+
+	// Try find a suitable free run
+	const auto index = FindFreeRun(required_chunks);
+	if (index == _num_chunks)
+	{
+		// Every free run was walked, none of them can be this big until blocks are freed or moved
+		_max_run_chunks = std::min(_max_run_chunks, required_chunks - 1);
+		return nullptr;
+	}
+
+	// Mark the run as an allocated block
+	SetUsedBits(index, required_chunks, true);
+	SetBits(_start_bits, index, 1, true);
+	_free_chunks -= required_chunks;
+
+	// Allocating at the lowest free chunk pushes it up
+	if (index == _first_free_chunk)
+		_first_free_chunk = FindFreeChunk(index + required_chunks);
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(&_data[index], ALLOC_PATTERN, required_chunks);
+
+	AssertHeapInvariants();
+
+	return _pointer_list.Create(&_data[index]);
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::Free(DefraggablePointerControlBlock &ptr)
+{
+	AssertHeapInvariants();
+
+	void* data = ptr.Get();
+
+	// We cannot free the null pointer
+	if (!data)
+		return;
+
+	// Get the offset of the pointer into the heap
+	const auto block_addr = static_cast<HeapChunk*>(data);
+	const std::ptrdiff_t offset = block_addr - _data;
+
+	// Is the offset in a valid range, the null sentinel is never freed
+	if (offset <= ptrdiff_t(NULL_INDEX) || offset >= ptrdiff_t(_num_chunks))
+		return;
+
+	// Is the data pointer of expected alignment
+	if (block_addr != &_data[offset])
+		return;
+
+	const auto index = IndexType(offset);
+	const auto num_chunks = GetBlockChunks(index);
+
+	// Invalidate defraggable pointers that point into the block before we invalidate data in the heap
+	if (PointerPolicy::INVALIDATE_ALIASES)
+		_pointer_list.RemovePointersInRange(&_data[index], &_data[index + num_chunks]);
+	else
+		ptr = nullptr;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(&_data[index], FREED_PATTERN, num_chunks);
+
+	// Free runs merge on their own, there are no headers to coalesce
+	SetUsedBits(index, num_chunks, false);
+	SetBits(_start_bits, index, 1, false);
+	_free_chunks += num_chunks;
+	_first_free_chunk = std::min(_first_free_chunk, index);
+
+	// The freed chunks merge with the free runs around them
+	_max_run_chunks = std::max(_max_run_chunks, GetFreeRunChunks(index));
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::FullDefrag()
+{
+	AssertHeapInvariants();
+
+	// A block's destination is the number of allocated chunks below it, a running prefix sum over the used bits
+	IndexType target = _first_free_chunk;
+	IndexType index = FindBlock(target);
+
+	while (index < _num_chunks)
+	{
+		const auto num_chunks = GetBlockChunks(index);
+		const auto next = FindBlock(index + num_chunks);
+
+		// Update defraggable pointers before moving the block
+		_pointer_list.OffsetPointersInRange(&_data[index], &_data[index + num_chunks], (ptrdiff_t(target) - ptrdiff_t(index)) * 16);
+		SIMDMemCopy(&_data[target], &_data[index], num_chunks);
+
+		// Only the starts behind the scan are rewritten, the used bits are rebuilt after it
+		SetBits(_start_bits, index, 1, false);
+		SetBits(_start_bits, target, 1, true);
+
+		target += num_chunks;
+		index = next;
+	}
+
+	// Every allocated chunk is now below the target
+	SetUsedBits(_first_free_chunk, target - _first_free_chunk, true);
+	SetUsedBits(target, _num_chunks - target, false);
+	_first_free_chunk = target;
+	_max_run_chunks = _free_chunks;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(&_data[target], MOVE_PATTERN, _num_chunks - target);
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+bool BitmapHeapEngine<Policies>::IterateHeap()
+{
+	AssertHeapInvariants();
+
+	// Do we actually need to defrag the heap
+	if (IsFullyDefragmented())
+		return true;
+
+	// Get the lowest free chunk and the first block after it
+	const auto free_index = _first_free_chunk;
+	const auto index = FindBlock(free_index);
+	assert(index < _num_chunks);
+
+	const auto num_chunks = GetBlockChunks(index);
+
+	// Update defraggable pointers before invalidating the heap
+	_pointer_list.OffsetPointersInRange(&_data[index], &_data[index + num_chunks], (ptrdiff_t(free_index) - ptrdiff_t(index)) * 16);
+
+	// Move the data down into the free run
+	SIMDMemCopy(&_data[free_index], &_data[index], num_chunks);
+
+	// Move the block bits, clearing first as the ranges may overlap
+	SetUsedBits(index, num_chunks, false);
+	SetUsedBits(free_index, num_chunks, true);
+	SetBits(_start_bits, index, 1, false);
+	SetBits(_start_bits, free_index, 1, true);
+
+	// Debug set the chunks the block moved out of
+	if (DebugPolicy::FILL_PATTERNS)
+	{
+		const auto vacated = std::max(free_index + num_chunks, index);
+		SIMDMemSet(&_data[vacated], MOVE_PATTERN, index + num_chunks - vacated);
+	}
+
+	_first_free_chunk = FindFreeChunk(free_index + num_chunks);
+
+	// The chunks the block moved out of merge with the rest of the run it moved into
+	if (_first_free_chunk < _num_chunks)
+		_max_run_chunks = std::max(_max_run_chunks, GetFreeRunChunks(_first_free_chunk));
+
+	AssertHeapInvariants();
+
+	return IsFullyDefragmented();
+}
+
+template <typename Policies>
+void BitmapHeapEngine<Policies>::AssertHeapInvariants() const
+{
+#ifdef NDEBUG
+	// We don't want to call this in release code
+	return;
+#endif
+
+	// The debug policy may opt out of invariant checking
+	if (!DebugPolicy::CHECK_INVARIANTS)
+		return;
+
+	/**
+	*	Bitmap heap keeps a one chunk null sentinel block at the start of the heap.
+	*/
+	{
+		assert(_used_bits[0] & 1);
+		assert(_start_bits[0] & 1);
+		assert(GetBlockChunks(NULL_INDEX) == 1);
+	}
+
+	/**
+	*	Bitmap heap marks the bits past the heap as one allocated block so scans stop at the end of the heap.
+	*/
+	{
+		for (auto index = _num_chunks; index < _num_words * 64; ++index)
+		{
+			assert((_used_bits[index / 64] >> (index % 64)) & 1);
+			assert(((_start_bits[index / 64] >> (index % 64)) & 1) == (index == _num_chunks));
+		}
+	}
+
+	/**
+	*	Bitmap heap summarizes which words of the used bitmap have free and allocated chunks.
+	*/
+	{
+		for (IndexType w = 0; w < _num_summary_words * 64; ++w)
+		{
+			const bool has_free = w < _num_words && _used_bits[w] != ~uint64_t(0);
+			const bool has_used = w < _num_words && _used_bits[w] != 0;
+
+			assert(((_free_words[w / 64] >> (w % 64)) & 1) == has_free);
+			assert(((_used_words[w / 64] >> (w % 64)) & 1) == has_used);
+		}
+	}
+
+	/**
+	*	Bitmap heap only starts blocks on allocated chunks.
+	*/
+	{
+		for (IndexType w = 0; w < _num_words; ++w)
+			assert(!(_start_bits[w] & ~_used_bits[w]));
+	}
+
+	/**
+	*	Bitmap heap tracks the total number of free chunks in the heap. This should be the number of clear used bits.
+	*/
+	{
+		IndexType used = 0;
+		for (IndexType w = 0; w < _num_words; ++w)
+			used += IndexType(__popcnt64(_used_bits[w]));
+
+		// The bits past the heap are set too
+		assert(used - (_num_words * 64 - _num_chunks) == _num_chunks - _free_chunks);
+	}
+
+	/**
+	*	Bitmap heap tracks the lowest free chunk in the heap.
+	*/
+	{
+		assert(FindFreeChunk(0) == _first_free_chunk);
+	}
+
+	/**
+	*	Bitmap heap tracks an upper bound on the size of its free runs.
+	*/
+	{
+		IndexType index = _first_free_chunk;
+		while (index < _num_chunks)
+		{
+			const auto end = FindSetBit(index, _num_chunks, _used_words, [this](IndexType w) { return _used_bits[w]; });
+			assert(end - index <= _max_run_chunks);
+			assert(GetFreeRunChunks(index) == end - index);
+
+			index = FindFreeChunk(end);
+		}
+	}
+}
+
+// Instantiate the engine for the supported policy combinations
+INSTANTIATE_HEAP_ENGINE_FOR_FIT(BitmapHeapEngine, FirstFitPolicy)
\ No newline at end of file
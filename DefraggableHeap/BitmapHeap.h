@@ -0,0 +1,270 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "BasicDefraggableHeap.h"
+#include "DefraggablePointerList.h"
+#include "HeapCommon.h"
+#include "HeapPolicies.h"
+
+#include <cstdint>
+
+/**
+*	A defraggable heap engine that tracks chunks in occupancy bitmaps instead of block headers.
+*	One bitmap marks the allocated chunks and another marks the first chunk of every allocated block,
+*	so block sizes never cost payload space and free runs are found with word wide bit scans.
+*	The used bitmap is summarized one bit per word, letting scans skip full or empty words 64 at a time.
+*
+*	@tparam Policies the HeapPolicies bundle the engine is compiled for
+*/
+template <typename Policies>
+class BitmapHeapEngine
+{
+
+public:
+
+	typedef typename Policies::FitPolicy FitPolicy;
+	typedef typename Policies::PointerPolicy PointerPolicy;
+	typedef typename Policies::DebugPolicy DebugPolicy;
+
+	/**
+	*	Constructs a bitmap heap.
+	*
+	*	@param size the size of the heap in bytes.
+	*/
+	BitmapHeapEngine(size_t size);
+
+	/**
+	*	Destroys a bitmap heap.
+	*/
+	~BitmapHeapEngine();
+
+	/**
+	*	Allocates from the bitmap heap. Always 16 byte aligned.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes);
+
+	/**
+	*	Frees the given heap data. Invalidates all defraggable pointers
+	*	pointing into the free block, or only the given pointer if the 
+	*	pointer policy does not track aliases.
+	*
+	*	@param ptr pointer into block in heap to free
+	*/
+	void Free(DefraggablePointerControlBlock &ptr);
+
+	/**
+	*	Fully Defragments the heap in a single pass, sliding every block down to the 
+	*	number of allocated chunks below it.
+	*/
+	void FullDefrag();
+
+	/**
+	*	Iterates the defragmentation process on the heap.
+	*	Heap is still valid for use after a call to this method.
+	*
+	*	@returns true if the heap is now fully defragmented
+	*/
+	bool IterateHeap();
+
+	/**
+	*	Gets the fragmentation ratio of the heap.
+	*
+	*	@returns 0 if no fragmentation, 1 if fully fragmented
+	*/
+	float FragmentationRatio() const;
+
+	/**
+	*	Gets if the heap is fully defragmented.
+	*
+	*	@returns true if fully defragmented, false if there is fragmentation
+	*/
+	bool IsFullyDefragmented() const;
+
+protected:
+
+	/**
+	*	Allocates a block of the given number of chunks.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunks(IndexType required_chunks);
+
+	/**
+	*	Finds the lowest addressed run of free chunks of desired size.
+	*
+	*	@param num_chunks the minimum number of chunks required in the run
+	*	@returns the first chunk of the run, the number of chunks in the heap if there is none
+	*/
+	IndexType FindFreeRun(IndexType num_chunks) const;
+
+	/**
+	*	Finds the first set bit in a range of a bitmap produced word by word.
+	*	Words without a set bit are skipped with a single compare, or 64 at a time with a summary.
+	*
+	*	@param from the chunk to start searching at
+	*	@param to the chunk to stop searching before
+	*	@param summary one bit per word, set if the word has a set bit, or null to visit every word
+	*	@param word the function producing the bitmap word at a given word index
+	*	@returns the chunk of the set bit, the end of the range if there is none
+	*/
+	template <typename WordFunction>
+	IndexType FindSetBit(IndexType from, IndexType to, const uint64_t *summary, WordFunction word) const;
+
+	/**
+	*	Finds the first set bit in a summary at or after the given word.
+	*
+	*	@param summary the summary to search
+	*	@param from the word to start searching at
+	*	@param last the last word to search
+	*	@returns the word of the set bit, past the last word if there is none
+	*/
+	IndexType FindSummaryBit(const uint64_t *summary, IndexType from, IndexType last) const;
+
+	/**
+	*	Finds the last allocated chunk before the given chunk.
+	*
+	*	@param before the chunk to search backwards from
+	*	@returns the allocated chunk, the null sentinel bounds the search
+	*/
+	IndexType FindLastUsedChunk(IndexType before) const;
+
+	/**
+	*	Gets the number of chunks in the free run containing the given free chunk.
+	*
+	*	@param index a free chunk of the run
+	*	@returns the number of chunks in the run
+	*/
+	IndexType GetFreeRunChunks(IndexType index) const;
+
+	/**
+	*	Finds the first free chunk at or after the given chunk.
+	*
+	*	@param from the chunk to start searching at
+	*	@returns the free chunk, the number of chunks in the heap if there is none
+	*/
+	IndexType FindFreeChunk(IndexType from) const;
+
+	/**
+	*	Finds the first allocated block starting at or after the given chunk.
+	*
+	*	@param from the chunk to start searching at, a free chunk or the end of a block
+	*	@returns the first chunk of the block, the number of chunks in the heap if there is none
+	*/
+	IndexType FindBlock(IndexType from) const;
+
+	/**
+	*	Gets the number of chunks in the given allocated block. The block ends at the next block start or free chunk.
+	*
+	*	@param index the first chunk of the block
+	*	@returns the number of chunks in the block
+	*/
+	IndexType GetBlockChunks(IndexType index) const;
+
+	/**
+	*	Sets or clears a range of bits in a bitmap.
+	*
+	*	@param bits the bitmap to modify
+	*	@param first the first bit of the range
+	*	@param count the number of bits in the range
+	*	@param value true to set the bits, false to clear them
+	*/
+	static void SetBits(uint64_t *bits, IndexType first, IndexType count, bool value);
+
+	/**
+	*	Sets or clears a range of the used bits, keeping their summaries up to date.
+	*
+	*	@param first the first chunk of the range
+	*	@param count the number of chunks in the range
+	*	@param value true to mark the chunks allocated, false to mark them free
+	*/
+	void SetUsedBits(IndexType first, IndexType count, bool value);
+
+	/**
+	*	Recomputes the summary bits of a range of used bitmap words.
+	*
+	*	@param first_word the first word of the range
+	*	@param end_word the word after the range
+	*/
+	void UpdateSummaries(IndexType first_word, IndexType end_word);
+
+	/**
+	*	Asserts invariants over the heap.
+	*/
+	void AssertHeapInvariants() const;
+
+	/**< The payload chunks we manage. */
+	HeapChunk* _data;
+
+	/**< One bit per chunk, set if the chunk belongs to an allocated block. The bits past the heap are set. */
+	uint64_t* _used_bits;
+
+	/**< One bit per chunk, set on the first chunk of every allocated block. The first bit past the heap is set. */
+	uint64_t* _start_bits;
+
+	/**< One bit per word of the used bits, set if the word has a free chunk. */
+	uint64_t* _free_words;
+
+	/**< One bit per word of the used bits, set if the word has an allocated chunk. */
+	uint64_t* _used_words;
+
+	/**< Blocks have no headers, the size lives in the bitmaps. */
+	IndexType _header_chunks;
+
+	/**< The number of chunks in the heap. */
+	IndexType _num_chunks;
+
+	/**< The number of 64 bit words in each bitmap, including at least one bit past the heap. */
+	IndexType _num_words;
+
+	/**< The number of 64 bit words in each summary. */
+	IndexType _num_summary_words;
+
+	/**< The total number of free chunks in the heap. */
+	IndexType _free_chunks;
+
+	/**< The lowest free chunk in the heap, every chunk below it is allocated. */
+	IndexType _first_free_chunk;
+
+	/**< An upper bound on the size of the free runs, failed searches lower it so they are not repeated. */
+	IndexType _max_run_chunks;
+
+	/**< The list of defraggable pointers for this heap. */
+	DefraggablePointerList _pointer_list;
+
+	/**< The chunk of the null sentinel block. */
+	static const IndexType NULL_INDEX = 0;
+};
+
+/**
+*	A defraggable heap implemented as occupancy bitmaps with the default policies.
+*/
+typedef BasicDefraggableHeap<BitmapHeapEngine> BitmapHeap;
\ No newline at end of file
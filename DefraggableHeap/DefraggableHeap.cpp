@@ -24,7 +24,7 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-// AATreePlayground.cpp : Defines the entry point for the console application.
+// DefraggableHeap.cpp : Defines the entry point for the console application.
 //
 
 #include "stdafx.h"
@@ -38,9 +38,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <functional>
 #include <random>
+#include <thread>
 
 #include "SplayHeap.h"
 #include "ListHeap.h"
+#include "AATreeHeap.h"
+#include "FreeSplayHeap.h"
+#include "BitmapHeap.h"
+#include "GenerationalHeap.h"
+#include "SIMDMem.h"
+#include "AlignedAllocator.h"
 
 #include <windows.h>
 
@@ -93,6 +100,82 @@ const char * const GetTypeString(const SplayHeap&)
 	return "SplayHeap";
 }
 
+const char * const GetTypeString(const AATreeHeap&)
+{
+	return "AATreeHeap";
+}
+
+const char * const GetTypeString(const FreeSplayHeap&)
+{
+	return "FreeSplayHeap";
+}
+
+const char * const GetTypeString(const BitmapHeap&)
+{
+	return "BitmapHeap";
+}
+
+typedef BasicDefraggableHeap<ListHeapEngine, NextFitPolicy> NextFitListHeap;
+
+const char * const GetTypeString(const NextFitListHeap&)
+{
+	return "NextFitListHeap";
+}
+
+typedef BasicDefraggableHeap<SplayHeapEngine, NextFitPolicy> NextFitSplayHeap;
+
+const char * const GetTypeString(const NextFitSplayHeap&)
+{
+	return "NextFitSplayHeap";
+}
+
+typedef BasicDefraggableHeap<ListHeapEngine, BestFitPolicy> BestFitListHeap;
+
+const char * const GetTypeString(const BestFitListHeap&)
+{
+	return "BestFitListHeap";
+}
+
+typedef BasicDefraggableHeap<SplayHeapEngine, BestFitPolicy> BestFitSplayHeap;
+
+const char * const GetTypeString(const BestFitSplayHeap&)
+{
+	return "BestFitSplayHeap";
+}
+
+typedef BasicDefraggableHeap<ListHeapEngine, IndexedFirstFitPolicy> IndexedListHeap;
+
+const char * const GetTypeString(const IndexedListHeap&)
+{
+	return "IndexedListHeap";
+}
+
+typedef BasicDefraggableHeap<SplayHeapEngine, IndexedFirstFitPolicy> IndexedSplayHeap;
+
+const char * const GetTypeString(const IndexedSplayHeap&)
+{
+	return "IndexedSplayHeap";
+}
+
+typedef BasicDefraggableHeap<ListHeapEngine, PackedFirstFitPolicy> PackedListHeap;
+
+const char * const GetTypeString(const PackedListHeap&)
+{
+	return "PackedListHeap";
+}
+
+typedef BasicDefraggableHeap<SplayHeapEngine, PackedFirstFitPolicy> PackedSplayHeap;
+
+const char * const GetTypeString(const PackedSplayHeap&)
+{
+	return "PackedSplayHeap";
+}
+
+const char * const GetTypeString(const GenerationalHeap&)
+{
+	return "GenerationalHeap";
+}
+
 const char * const UNIT_STRING = "ms";
 
 std::vector<uint32_t> EratosthenesSieve(uint32_t upper_bound) 
@@ -421,6 +504,9 @@ void RandomBenchmark(T& heap)
 
 	auto post_benchmark = [&]()
 	{
+		// Report how fragmented the workload left the heap
+		std::cout << "Fragmentation: " << heap.FragmentationRatio() << std::endl;
+
 		// Return all allocated data to the heap
 		for (auto &i : blas)
 			heap.Free(i);
@@ -432,14 +518,320 @@ void RandomBenchmark(T& heap)
 	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Random Benchmark");
 }
 
+template <typename T>
+void HoleFitBenchmark(T& heap, size_t num_holes)
+{
+	std::vector<DefraggablePointerControlBlock> blas;
+	std::vector<DefraggablePointerControlBlock> fits;
+	blas.reserve(CHUNKS / 2);
+	static const size_t ITERATIONS = 4096;
+	fits.reserve(ITERATIONS);
+
+	auto pre_benchmark = [&]()
+	{
+		// Allocate ALLOC_SIZES until we fail
+		while (auto alloc = heap.Allocate(ALLOC_SIZE))
+			blas.push_back(std::move(alloc));
+
+		// Punch evenly spaced single block holes, none of which fit the benchmark allocations
+		const auto tail = blas.size() - 3 * ITERATIONS;
+		const auto stride = std::max<size_t>(2, tail / num_holes);
+		for (size_t i = 0; i < tail; i += stride)
+			heap.Free(blas[i]);
+
+		// Only the double block holes after them do
+		for (auto i = tail; i < blas.size(); i += 3)
+		{
+			heap.Free(blas[i]);
+			heap.Free(blas[i + 1]);
+		}
+	};
+
+	auto benchmark = [&]()
+	{
+		// Every allocation has to get past all the single block holes, and exactly fills a double block hole with its inline header
+		for (auto i = 0U; i < ITERATIONS; i++)
+			fits.push_back(heap.Allocate(2 * ALLOC_SIZE + 16));
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Return all allocated data to the heap
+		for (auto &i : fits)
+			heap.Free(i);
+
+		for (auto &i : blas)
+			heap.Free(i);
+
+		// Clear blas
+		fits.clear();
+		blas.clear();
+	};
+
+	std::cout << "Free list length: " << num_holes << std::endl;
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Hole Fit Benchmark");
+}
+
+template <typename T>
+void LargeBlockDefragBenchmark(T& heap, size_t block_size)
+{
+	std::vector<DefraggablePointerControlBlock> blas;
+	blas.reserve(HEAP_SIZE / block_size);
+	DefraggablePointerControlBlock hole;
+
+	auto pre_benchmark = [&]()
+	{
+		// Allocate large blocks until we fail
+		hole = heap.Allocate(block_size);
+		while (auto alloc = heap.Allocate(block_size))
+			blas.push_back(std::move(alloc));
+
+		// Every other block now has to move down by a whole block, without overlapping itself
+		heap.Free(hole);
+	};
+
+	auto benchmark = [&]()
+	{
+		while (!heap.IterateHeap());
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Return all allocated data to the heap
+		for (auto &i : blas)
+			heap.Free(i);
+
+		// Clear blas
+		blas.clear();
+	};
+
+	std::cout << "Block size: " << block_size << ", Streaming threshold: " << GetSIMDStreamingThreshold() << std::endl;
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Large Block Defrag Benchmark");
+}
+
+template <typename T>
+void SparseDefragBenchmark(T& heap, size_t free_stride, bool from_top)
+{
+	std::vector<DefraggablePointerControlBlock> blas;
+	blas.reserve(CHUNKS / 2);
+
+	auto pre_benchmark = [&]()
+	{
+		// Allocate ALLOC_SIZES until we fail
+		while (auto alloc = heap.Allocate(ALLOC_SIZE))
+			blas.push_back(std::move(alloc));
+
+		// Free a few blocks spread over the heap, most of the live data sits above the first hole
+		for (size_t i = 0; i < blas.size(); i += free_stride)
+			heap.Free(blas[i]);
+	};
+
+	auto benchmark = [&]()
+	{
+		if (from_top)
+			heap.FullDefragFromTop();
+		else
+			heap.FullDefrag();
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Return all allocated data to the heap
+		for (auto &i : blas)
+			heap.Free(i);
+
+		// Clear blas
+		blas.clear();
+	};
+
+	std::cout << "Free stride: " << free_stride << ", From top: " << from_top << std::endl;
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Sparse Defrag Benchmark");
+}
+
+template <typename T>
+void CompactIntoBenchmark(T& heap, size_t num_threads)
+{
+	std::vector<DefraggablePointerControlBlock> blas;
+	blas.reserve(CHUNKS / 2);
+
+	// The spare storage the heap compacts into, swapped with the heap's own each run
+	auto buffer = static_cast<HeapChunk*>(AlignedNew(HEAP_SIZE, 16));
+
+	auto pre_benchmark = [&]()
+	{
+		// Allocate ALLOC_SIZES until we fail
+		while (auto alloc = heap.Allocate(ALLOC_SIZE))
+			blas.push_back(std::move(alloc));
+
+		// Free every second block to maximize fragmentation
+		for (size_t i = 0; i < blas.size(); i += 2)
+			heap.Free(blas[i]);
+	};
+
+	auto benchmark = [&]()
+	{
+		buffer = heap.CompactInto(buffer, num_threads);
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Return all allocated data to the heap
+		for (auto &i : blas)
+			heap.Free(i);
+
+		// Clear blas
+		blas.clear();
+	};
+
+	std::cout << "Threads: " << num_threads << std::endl;
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Compact Into Benchmark");
+
+	AlignedDelete(buffer);
+}
+
+template <typename T>
+void AutoDefragBenchmark(T& heap, const AutoDefragPolicy &policy)
+{
+	std::vector<DefraggablePointerControlBlock> blas;
+	blas.reserve(CHUNKS / 2);
+
+	std::mt19937 engine(SEED);
+	std::uniform_int_distribution<int> dist(0, 5);
+	std::uniform_int_distribution<int> alloc_dist(1, 1024 * 1024);
+	static const size_t ITERATIONS = 1000000;
+	size_t failed_allocations = 0;
+
+	auto pre_benchmark = [&]()
+	{
+		heap.SetAutoDefragPolicy(policy);
+		failed_allocations = 0;
+	};
+
+	auto benchmark = [&]()
+	{
+		// Run the random workload without defragging by hand, the policy does it
+		for (auto i = 0U; i < ITERATIONS; i++)
+		{
+			if (dist(engine) < 3)
+			{
+				// Allocate some data
+				if (auto alloc = heap.Allocate(alloc_dist(engine)))
+					blas.push_back(std::move(alloc));
+				else
+					failed_allocations++;
+			}
+			else if (!blas.empty())
+			{
+				// Free some data
+				auto it = blas.begin() + std::uniform_int_distribution<int>(0, blas.size() - 1)(engine);
+				heap.Free(*it);
+				blas.erase(it);
+			}
+		}
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Report how fragmented the workload left the heap
+		std::cout << "Fragmentation: " << heap.FragmentationRatio() << ", Failed allocations: " << failed_allocations << std::endl;
+
+		// Return all allocated data to the heap without defragging it again
+		heap.SetAutoDefragPolicy(AutoDefragPolicy());
+		for (auto &i : blas)
+			heap.Free(i);
+
+		// Clear blas
+		blas.clear();
+	};
+
+	std::cout << "Start ratio: " << policy._start_ratio << ", Stop ratio: " << policy._stop_ratio << ", Budget: " << policy._budget << std::endl;
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Auto Defrag Benchmark");
+}
+
+template <typename T>
+void GenerationalBenchmark(T& heap)
+{
+	std::vector<DefraggablePointerControlBlock> long_lived;
+	std::vector<DefraggablePointerControlBlock> short_lived;
+	static const size_t REQUESTS = 20000;
+	static const size_t SHORT_LIVED_PER_REQUEST = 64;
+	static const size_t MAX_LONG_LIVED = 2048;
+	long_lived.reserve(MAX_LONG_LIVED + 1);
+	short_lived.reserve(SHORT_LIVED_PER_REQUEST);
+
+	std::mt19937 engine(SEED);
+	std::uniform_int_distribution<int> short_dist(16, 4096);
+	std::uniform_int_distribution<int> long_dist(16, 16384);
+
+	auto pre_benchmark = [&]()
+	{
+
+	};
+
+	auto benchmark = [&]()
+	{
+		for (auto i = 0U; i < REQUESTS; i++)
+		{
+			// Most allocations of a request die with it
+			for (auto j = 0U; j < SHORT_LIVED_PER_REQUEST; j++)
+				if (auto alloc = heap.Allocate(short_dist(engine)))
+					short_lived.push_back(std::move(alloc));
+
+			// One outlives it, once enough have an old one dies
+			if (auto alloc = heap.Allocate(long_dist(engine)))
+				long_lived.push_back(std::move(alloc));
+			if (long_lived.size() > MAX_LONG_LIVED)
+			{
+				auto it = long_lived.begin() + std::uniform_int_distribution<int>(0, long_lived.size() - 1)(engine);
+				heap.Free(*it);
+				long_lived.erase(it);
+			}
+
+			for (auto &alloc : short_lived)
+				heap.Free(alloc);
+			short_lived.clear();
+
+			// Defrag once per request
+			heap.IterateHeap();
+		}
+	};
+
+	auto post_benchmark = [&]()
+	{
+		// Report how fragmented the long lived blocks left the heap
+		std::cout << "Fragmentation: " << heap.FragmentationRatio() << std::endl;
+
+		// Return all allocated data to the heap
+		for (auto &i : long_lived)
+			heap.Free(i);
+
+		// Clear blas
+		long_lived.clear();
+	};
+
+	RunBenchmark(pre_benchmark, benchmark, post_benchmark, heap, "Generational Benchmark");
+}
+
 int _tmain(int , _TCHAR*[])
 {
 	TIMING_SCALE = GetTiming();
 	SEED = SamplePerformanceCounter();
-	std::cout << "Timing: " << TIMING_SCALE << ", Seed: " << SEED << std::endl << std::endl;
+	std::cout << "Timing: " << TIMING_SCALE << ", Seed: " << SEED << ", SIMD Level: " << GetSIMDLevel() << std::endl << std::endl;
 
 	ListHeap list(HEAP_SIZE);
 	SplayHeap splay(HEAP_SIZE);
+	AATreeHeap aa_tree(HEAP_SIZE);
+	FreeSplayHeap free_splay(HEAP_SIZE);
+	BitmapHeap bitmap(HEAP_SIZE);
+	NextFitListHeap next_fit_list(HEAP_SIZE);
+	NextFitSplayHeap next_fit_splay(HEAP_SIZE);
+	BestFitListHeap best_fit_list(HEAP_SIZE);
+	BestFitSplayHeap best_fit_splay(HEAP_SIZE);
+	IndexedListHeap indexed_list(HEAP_SIZE);
+	IndexedSplayHeap indexed_splay(HEAP_SIZE);
+	PackedListHeap packed_list(HEAP_SIZE);
+	PackedSplayHeap packed_splay(HEAP_SIZE);
+	GenerationalHeap generational(HEAP_SIZE / 8, HEAP_SIZE);
 
 	/** 
 		--- Pure Allocate Benchmark ---
@@ -448,6 +840,9 @@ int _tmain(int , _TCHAR*[])
 	**/
 	PureAllocationBenchmark(list);
 	PureAllocationBenchmark(splay);
+	PureAllocationBenchmark(aa_tree);
+	PureAllocationBenchmark(free_splay);
+	PureAllocationBenchmark(bitmap);
 
 	/**
 		--- Full Defragmentation Benchmark ---
@@ -456,6 +851,9 @@ int _tmain(int , _TCHAR*[])
 	**/
     //FullDefragBenchmark(list);
     //FullDefragBenchmark(splay);
+    //FullDefragBenchmark(aa_tree);
+    //FullDefragBenchmark(free_splay);
+    //FullDefragBenchmark(bitmap);
 
 	/**
 		--- Pure Free Benchmark ---
@@ -464,6 +862,9 @@ int _tmain(int , _TCHAR*[])
 	**/
 	//PureFreeBenchmark(list);
 	//PureFreeBenchmark(splay);
+	//PureFreeBenchmark(aa_tree);
+	//PureFreeBenchmark(free_splay);
+	//PureFreeBenchmark(bitmap);
 
 	/**
 		--- Prime Stride Free Benchmark ---
@@ -472,6 +873,9 @@ int _tmain(int , _TCHAR*[])
 	**/
 	//PrimeStrideFreeBenchmark(list);
 	//PrimeStrideFreeBenchmark(splay);
+	//PrimeStrideFreeBenchmark(aa_tree);
+	//PrimeStrideFreeBenchmark(free_splay);
+	//PrimeStrideFreeBenchmark(bitmap);
 
 	/**
 		--- Stack Free Benchmark ---
@@ -480,6 +884,9 @@ int _tmain(int , _TCHAR*[])
 	**/
 	//StackBenchmark(list);
 	//StackBenchmark(splay);
+	//StackBenchmark(aa_tree);
+	//StackBenchmark(free_splay);
+	//StackBenchmark(bitmap);
 
 	/**
 		--- Random Benchmark ---
@@ -488,6 +895,91 @@ int _tmain(int , _TCHAR*[])
 	**/
 	//RandomBenchmark(list);
 	//RandomBenchmark( splay );
+	//RandomBenchmark(aa_tree);
+	//RandomBenchmark(free_splay);
+	//RandomBenchmark(bitmap);
+	//RandomBenchmark(next_fit_list);
+	//RandomBenchmark(next_fit_splay);
+	//RandomBenchmark(best_fit_list);
+	//RandomBenchmark(best_fit_splay);
+	//RandomBenchmark(indexed_list);
+	//RandomBenchmark(indexed_splay);
+	//RandomBenchmark(packed_list);
+	//RandomBenchmark(packed_splay);
+
+	/**
+		--- Hole Fit Benchmark ---
+
+		Benchmarks allocating past a growing number of free blocks that are too small.
+	**/
+	//for (size_t holes = 16; holes <= CHUNKS / 128; holes *= 8)
+	//{
+	//	HoleFitBenchmark(list, holes);
+	//	HoleFitBenchmark(indexed_list, holes);
+	//	HoleFitBenchmark(packed_list, holes);
+	//	HoleFitBenchmark(splay, holes);
+	//	HoleFitBenchmark(indexed_splay, holes);
+	//	HoleFitBenchmark(packed_splay, holes);
+	//	HoleFitBenchmark(bitmap, holes);
+	//}
+
+	/**
+		--- Large Block Defrag Benchmark ---
+
+		Benchmarks sliding large blocks with regular and with streaming stores.
+	**/
+	//for (size_t block_size = 256 * 1024; block_size <= HEAP_SIZE / 4; block_size *= 4)
+	//{
+	//	SetSIMDStreamingThreshold(SIZE_MAX);
+	//	LargeBlockDefragBenchmark(splay, block_size);
+	//	SetSIMDStreamingThreshold(block_size / 16);
+	//	LargeBlockDefragBenchmark(splay, block_size);
+	//}
+
+	/**
+		--- Sparse Defrag Benchmark ---
+
+		Benchmarks sliding compaction against filling holes from the top of the heap.
+	**/
+	//for (size_t free_stride = 4; free_stride <= 64; free_stride *= 4)
+	//{
+	//	SparseDefragBenchmark(list, free_stride, false);
+	//	SparseDefragBenchmark(list, free_stride, true);
+	//	SparseDefragBenchmark(splay, free_stride, false);
+	//	SparseDefragBenchmark(splay, free_stride, true);
+	//}
+
+	/**
+		--- Compact Into Benchmark ---
+
+		Benchmarks copying compaction into spare storage on a growing number of threads,
+		compare with the Full Defragmentation Benchmark.
+	**/
+	//for (size_t num_threads = 1; num_threads <= std::thread::hardware_concurrency(); num_threads *= 2)
+	//{
+	//	CompactIntoBenchmark(list, num_threads);
+	//	CompactIntoBenchmark(splay, num_threads);
+	//}
+
+	/**
+		--- Auto Defrag Benchmark ---
+
+		Benchmarks a random workload with no defragmentation against one the heap defragments itself.
+	**/
+	//AutoDefragBenchmark(list, AutoDefragPolicy());
+	//AutoDefragBenchmark(list, AutoDefragPolicy(0.5f, 0.25f, 4));
+	//AutoDefragBenchmark(splay, AutoDefragPolicy());
+	//AutoDefragBenchmark(splay, AutoDefragPolicy(0.5f, 0.25f, 4));
+
+	/**
+		--- Generational Benchmark ---
+
+		Benchmarks a request workload where most blocks die young, defragging once per request.
+	**/
+	//GenerationalBenchmark(splay);
+	//GenerationalBenchmark(generational);
+	//generational.GetOldGeneration().SetAutoDefragPolicy(AutoDefragPolicy(0.5f, 0.25f, 4));
+	//GenerationalBenchmark(generational);
 
 	return 0;
 }
\ No newline at end of file
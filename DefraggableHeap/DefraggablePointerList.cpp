@@ -28,6 +28,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "DefraggablePointerList.h"
 
+#include <algorithm>
+
 DefraggablePointerList::DefraggablePointerList()
 	: _pointer_root(nullptr, &_pointer_root, &_pointer_root)
 {
@@ -120,6 +122,49 @@ void DefraggablePointerList::OffsetPointersInRange(void* lower_bound, void* uppe
 		if (addr >= lower && addr < upper)
 			n->_prev = reinterpret_cast<DefraggablePointerControlBlock*>(addr + offset);
 
+		// Go to the next node
+		n = next;
+	} while (n != &_pointer_root);
+}
+
+void DefraggablePointerList::RelocatePointersInRange(void* lower_bound, void* upper_bound, const PointerRelocation* relocations, size_t num_relocations)
+{
+	// Get bounds as raw address values
+	intptr_t lower = intptr_t(lower_bound);
+	intptr_t upper = intptr_t(upper_bound);
+
+	// Relocates an address in the range by the last relocation starting at or below it
+	auto relocate = [=](intptr_t addr)
+	{
+		auto relocation = std::upper_bound(relocations, relocations + num_relocations, addr,
+			[](intptr_t a, const PointerRelocation &r) { return a < r._lower_bound; });
+		return relocation == relocations ? addr : addr + relocation[-1]._offset;
+	};
+
+	DefraggablePointerControlBlock *n = &_pointer_root;
+
+	// While we have not wrapped around to the beginning in the management list
+	// Relocate pointers that point into the range specified
+	do
+	{
+		// Cache the next pointer before modifying the current list item
+		auto next = n->_next;
+
+		// Does the data address lie in the range to relocate
+		intptr_t addr = intptr_t(n->_data);
+		if (addr >= lower && addr < upper)
+			n->_data = reinterpret_cast<void*>(relocate(addr));
+
+		// Does the next address lie in the range to relocate
+		addr = intptr_t(n->_next);
+		if (addr >= lower && addr < upper)
+			n->_next = reinterpret_cast<DefraggablePointerControlBlock*>(relocate(addr));
+
+		// Does the previous address lie in the range to relocate
+		addr = intptr_t(n->_prev);
+		if (addr >= lower && addr < upper)
+			n->_prev = reinterpret_cast<DefraggablePointerControlBlock*>(relocate(addr));
+
 		// Go to the next node
 		n = next;
 	} while (n != &_pointer_root);
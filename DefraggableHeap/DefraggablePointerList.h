@@ -28,6 +28,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "DefraggablePointerControlBlock.h"
 
+#include <cstdint>
+
+/**
+*	Describes how far a range of addresses moves when a heap is relocated.
+*	The range runs from its lower bound up to the lower bound of the next relocation.
+*/
+struct PointerRelocation
+{
+	/**< The inclusive lower bound of the addresses that move. */
+	intptr_t _lower_bound;
+
+	/**< The offset in bytes to change pointers in the range by. */
+	intptr_t _offset;
+};
+
 /**
 *	Manages a defraggable pointer list on behalf of a defraggable heap. 
 */
@@ -71,6 +86,17 @@ public:
 	*/
 	void OffsetPointersInRange(void* lower_bound, void* upper_bound, ptrdiff_t offset);
 
+	/**
+	*	Relocates defraggable pointers that point into the given range of addresses,
+	*	offsetting each by the relocation covering its address.
+	*
+	*	@param lower_bound the inclusive lower bound that we should relocate
+	*	@param upper_bound the exclusive upper bound that we should relocate
+	*	@param relocations the relocations covering the range, sorted by lower bound
+	*	@param num_relocations the number of relocations
+	*/
+	void RelocatePointersInRange(void* lower_bound, void* upper_bound, const PointerRelocation* relocations, size_t num_relocations);
+
 	/**
 	*	Removes and invalidates all pointers in the managed pointer list.
 	*/
@@ -0,0 +1,406 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "FreeBlockIndex.h"
+#include "AlignedAllocator.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+FreeBlockIndex::FreeBlockIndex()
+	: _nodes(static_cast<FreeBlockIndexNode*>(AlignedNew(INITIAL_CAPACITY * sizeof(FreeBlockIndexNode), 64)))
+	, _capacity(INITIAL_CAPACITY)
+	, _used(1) // Node 0 stands for no node
+	, _free_node(0)
+	, _root(0)
+	, _height(0)
+	, _count(0)
+{
+	_root = AllocateNode(true);
+}
+
+FreeBlockIndex::~FreeBlockIndex()
+{
+	AlignedDelete(_nodes);
+}
+
+void FreeBlockIndex::Insert(IndexType index, IndexType num_chunks)
+{
+	IndexType path[MAX_HEIGHT], slots[MAX_HEIGHT];
+	const auto depth = Descend(index, path, slots);
+	auto &leaf = _nodes[path[depth]];
+
+	// Keep the leaf sorted by block index
+	IndexType slot = 0;
+	while (slot < leaf._count && leaf._keys[slot] < index)
+		++slot;
+
+	assert(slot == leaf._count || leaf._keys[slot] != index);
+
+	InsertEntry(leaf, slot, index, num_chunks, 0);
+	++_count;
+
+	// Summaries first, the splits then divide a correct summary between the halves
+	UpdatePathStatistics(path, slots, depth);
+	SplitPath(path, slots, depth);
+}
+
+void FreeBlockIndex::Remove(IndexType index)
+{
+	IndexType path[MAX_HEIGHT], slots[MAX_HEIGHT];
+	auto depth = Descend(index, path, slots);
+	auto &leaf = _nodes[path[depth]];
+
+	IndexType slot = 0;
+	while (slot < leaf._count && leaf._keys[slot] != index)
+		++slot;
+
+	assert(slot < leaf._count);
+
+	RemoveEntry(leaf, slot);
+	--_count;
+
+	// Release emptied nodes, their parents simply forget them
+	while (depth > 0 && _nodes[path[depth]]._count == 0)
+	{
+		ReleaseNode(path[depth]);
+		--depth;
+		RemoveEntry(_nodes[path[depth]], slots[depth]);
+	}
+
+	UpdatePathStatistics(path, slots, depth);
+
+	// An empty tree starts over from a single leaf
+	if (_nodes[_root]._count == 0 && _height > 0)
+	{
+		ReleaseNode(_root);
+		_root = AllocateNode(true);
+		_height = 0;
+	}
+
+	// Drop inner roots with a single child so lookups do not walk idle levels
+	while (_height > 0 && _nodes[_root]._count == 1)
+	{
+		const auto old_root = _root;
+		_root = _nodes[old_root]._children[0];
+		ReleaseNode(old_root);
+		--_height;
+	}
+}
+
+void FreeBlockIndex::Resize(IndexType index, IndexType num_chunks)
+{
+	IndexType path[MAX_HEIGHT], slots[MAX_HEIGHT];
+	const auto depth = Descend(index, path, slots);
+	auto &leaf = _nodes[path[depth]];
+
+	IndexType slot = 0;
+	while (slot < leaf._count && leaf._keys[slot] != index)
+		++slot;
+
+	assert(slot < leaf._count);
+
+	leaf._num_chunks[slot] = num_chunks;
+	UpdatePathStatistics(path, slots, depth);
+}
+
+IndexType FreeBlockIndex::FindFirstFit(IndexType num_chunks) const
+{
+	if (GetMaxNumChunks() < num_chunks)
+		return 0;
+
+	// The summaries are exact, so the first large enough child always holds a fit
+	auto node_index = _root;
+	for (;;)
+	{
+		const auto &node = _nodes[node_index];
+
+		IndexType slot = 0;
+		while (node._num_chunks[slot] < num_chunks)
+			++slot;
+
+		assert(slot < node._count);
+
+		if (node._is_leaf)
+			return node._keys[slot];
+
+		node_index = node._children[slot];
+	}
+}
+
+IndexType FreeBlockIndex::FindPrevious(IndexType index) const
+{
+	IndexType path[MAX_HEIGHT], slots[MAX_HEIGHT];
+	const auto depth = Descend(index, path, slots);
+	const auto &leaf = _nodes[path[depth]];
+
+	IndexType slot = leaf._count;
+	while (slot > 0 && leaf._keys[slot - 1] >= index)
+		--slot;
+
+	if (slot > 0)
+		return leaf._keys[slot - 1];
+
+	// Otherwise the previous block is the last one of the nearest subtree to our left
+	for (auto d = depth; d > 0; --d)
+	{
+		if (slots[d - 1] > 0)
+		{
+			auto node = _nodes[path[d - 1]]._children[slots[d - 1] - 1];
+			while (!_nodes[node]._is_leaf)
+				node = _nodes[node]._children[_nodes[node]._count - 1];
+
+			return _nodes[node]._keys[_nodes[node]._count - 1];
+		}
+	}
+
+	return 0;
+}
+
+IndexType FreeBlockIndex::GetNumChunks(IndexType index) const
+{
+	IndexType path[MAX_HEIGHT], slots[MAX_HEIGHT];
+	const auto depth = Descend(index, path, slots);
+	const auto &leaf = _nodes[path[depth]];
+
+	for (IndexType slot = 0; slot < leaf._count; ++slot)
+	{
+		if (leaf._keys[slot] == index)
+			return leaf._num_chunks[slot];
+	}
+
+	return 0;
+}
+
+IndexType FreeBlockIndex::GetMaxNumChunks() const
+{
+	return GetNodeMax(_nodes[_root]);
+}
+
+IndexType FreeBlockIndex::GetCount() const
+{
+	return _count;
+}
+
+IndexType FreeBlockIndex::Descend(IndexType index, IndexType *path, IndexType *slots) const
+{
+	IndexType depth = 0;
+	path[0] = _root;
+
+	for (auto level = _height; level > 0; --level)
+	{
+		const auto &node = _nodes[path[depth]];
+
+		// Take the last child whose lower bound we reach, the first child has no lower bound
+		IndexType slot = 0;
+		while (slot + 1 < node._count && node._keys[slot + 1] <= index)
+			++slot;
+
+		slots[depth] = slot;
+		path[++depth] = node._children[slot];
+	}
+
+	return depth;
+}
+
+void FreeBlockIndex::SplitPath(IndexType *path, IndexType *slots, IndexType depth)
+{
+	static const IndexType half = FreeBlockIndexNode::CAPACITY / 2;
+
+	for (auto d = depth + 1; d-- > 0;)
+	{
+		if (_nodes[path[d]]._count < FreeBlockIndexNode::CAPACITY)
+			return;
+
+		// Take every node we need before referencing any, the pool may move
+		const auto right_index = AllocateNode(_nodes[path[d]]._is_leaf != 0);
+		const auto parent_index = d > 0 ? path[d - 1] : AllocateNode(false);
+		auto &node = _nodes[path[d]];
+		auto &right = _nodes[right_index];
+		auto &parent = _nodes[parent_index];
+
+		// Move the upper half of the entries into the new right sibling
+		right._count = node._count - half;
+		memcpy(right._num_chunks, node._num_chunks + half, right._count * sizeof(IndexType));
+		memcpy(right._keys, node._keys + half, right._count * sizeof(IndexType));
+		memcpy(right._children, node._children + half, right._count * sizeof(IndexType));
+		node._count = half;
+
+		if (d > 0)
+		{
+			parent._num_chunks[slots[d - 1]] = GetNodeMax(node);
+			InsertEntry(parent, slots[d - 1] + 1, right._keys[0], GetNodeMax(right), right_index);
+		}
+		else
+		{
+			// The root split, grow the tree by a level
+			InsertEntry(parent, 0, 0, GetNodeMax(node), path[d]);
+			InsertEntry(parent, 1, right._keys[0], GetNodeMax(right), right_index);
+			_root = parent_index;
+			++_height;
+
+			assert(_height < MAX_HEIGHT);
+		}
+	}
+}
+
+void FreeBlockIndex::UpdatePathStatistics(const IndexType *path, const IndexType *slots, IndexType depth)
+{
+	for (auto d = depth; d > 0; --d)
+	{
+		const auto node_max = GetNodeMax(_nodes[path[d]]);
+		auto &summary = _nodes[path[d - 1]]._num_chunks[slots[d - 1]];
+
+		// Summaries are exact, so an unchanged summary leaves every ancestor unchanged too
+		if (summary == node_max)
+			return;
+
+		summary = node_max;
+	}
+}
+
+IndexType FreeBlockIndex::GetNodeMax(const FreeBlockIndexNode &node)
+{
+	IndexType node_max = 0;
+	for (IndexType slot = 0; slot < node._count; ++slot)
+		node_max = std::max(node_max, node._num_chunks[slot]);
+
+	return node_max;
+}
+
+void FreeBlockIndex::InsertEntry(FreeBlockIndexNode &node, IndexType slot, IndexType key, IndexType num_chunks, IndexType child)
+{
+	assert(slot <= node._count && node._count < FreeBlockIndexNode::CAPACITY);
+
+	const auto tail = (node._count - slot) * sizeof(IndexType);
+	memmove(node._num_chunks + slot + 1, node._num_chunks + slot, tail);
+	memmove(node._keys + slot + 1, node._keys + slot, tail);
+	memmove(node._children + slot + 1, node._children + slot, tail);
+
+	node._num_chunks[slot] = num_chunks;
+	node._keys[slot] = key;
+	node._children[slot] = child;
+	++node._count;
+}
+
+void FreeBlockIndex::RemoveEntry(FreeBlockIndexNode &node, IndexType slot)
+{
+	assert(slot < node._count);
+
+	const auto tail = (node._count - slot - 1) * sizeof(IndexType);
+	memmove(node._num_chunks + slot, node._num_chunks + slot + 1, tail);
+	memmove(node._keys + slot, node._keys + slot + 1, tail);
+	memmove(node._children + slot, node._children + slot + 1, tail);
+	--node._count;
+}
+
+IndexType FreeBlockIndex::AllocateNode(bool is_leaf)
+{
+	IndexType node;
+
+	if (_free_node)
+	{
+		node = _free_node;
+		_free_node = _nodes[node]._children[0];
+	}
+	else
+	{
+		// Double the pool when it runs out
+		if (_used == _capacity)
+		{
+			auto *const nodes = static_cast<FreeBlockIndexNode*>(AlignedNew(2 * _capacity * sizeof(FreeBlockIndexNode), 64));
+			memcpy(nodes, _nodes, _capacity * sizeof(FreeBlockIndexNode));
+			AlignedDelete(_nodes);
+
+			_nodes = nodes;
+			_capacity *= 2;
+		}
+
+		node = _used++;
+	}
+
+	auto &n = _nodes[node];
+	n._count = 0;
+	n._is_leaf = is_leaf;
+	n._unused = 0;
+
+	return node;
+}
+
+void FreeBlockIndex::ReleaseNode(IndexType node)
+{
+	_nodes[node]._children[0] = _free_node;
+	_free_node = node;
+}
+
+void FreeBlockIndex::AssertInvariants() const
+{
+#ifdef NDEBUG
+	return;
+#endif
+
+	// Only the root may be empty, and only as a leaf
+	assert(_height == 0 || _nodes[_root]._count > 1);
+	assert(AssertSubtreeInvariants(_root, 0, IndexType(-1), _height) == _count);
+}
+
+IndexType FreeBlockIndex::AssertSubtreeInvariants(IndexType node_index, IndexType lower_bound, IndexType upper_bound, IndexType height) const
+{
+	const auto &node = _nodes[node_index];
+
+	assert(node._count < FreeBlockIndexNode::CAPACITY);
+	assert((node._is_leaf != 0) == (height == 0));
+	assert(node._count > 0 || node_index == _root);
+
+	if (node._is_leaf)
+	{
+		for (IndexType slot = 0; slot < node._count; ++slot)
+		{
+			assert(node._keys[slot] >= lower_bound && node._keys[slot] < upper_bound);
+			assert(slot == 0 || node._keys[slot - 1] < node._keys[slot]);
+			assert(node._num_chunks[slot] > 0);
+		}
+
+		return node._count;
+	}
+
+	IndexType count = 0;
+	for (IndexType slot = 0; slot < node._count; ++slot)
+	{
+		const auto child_lower = slot == 0 ? lower_bound : node._keys[slot];
+		const auto child_upper = slot + 1 == node._count ? upper_bound : node._keys[slot + 1];
+
+		assert(child_lower >= lower_bound && child_lower < child_upper && child_upper <= upper_bound);
+		assert(node._num_chunks[slot] == GetNodeMax(_nodes[node._children[slot]]));
+
+		count += AssertSubtreeInvariants(node._children[slot], child_lower, child_upper, height - 1);
+	}
+
+	return count;
+}
\ No newline at end of file
@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "HeapCommon.h"
+
+/**
+*	Defines a node of a free block index B+ tree.
+*
+*	Each array shares a cache line with one word of node metadata, so a fit search scanning the 
+*	block sizes of a node touches a single line before following a child or reading a leaf key.
+*/
+_declspec(align(64)) struct FreeBlockIndexNode
+{
+	/**< The number of entries a node holds, one is kept spare for overflow before a split. */
+	static const IndexType CAPACITY = 15;
+
+	/**< The free block sizes in a leaf, or the largest free block size of each child in an inner node. */
+	IndexType _num_chunks[CAPACITY];
+
+	/**< The number of entries in the node. */
+	IndexType _count;
+
+	/**< The free block indices in a leaf, or the lowest index each child may hold in an inner node. */
+	IndexType _keys[CAPACITY];
+
+	/**< Is the node a leaf. */
+	IndexType _is_leaf;
+
+	/**< The child nodes of an inner node, the next node of the pool free list for a released node. */
+	IndexType _children[CAPACITY];
+
+	/**< Unused, pads the node to three cache lines. */
+	IndexType _unused;
+};
+
+static_assert(sizeof(FreeBlockIndexNode) == 192, "A free block index node needs to be three cache lines in size.");
+
+/**
+*	A B+ tree of the free blocks of a heap keyed by block index, where every inner node records the largest
+*	free block below each of its children. Nodes are kept in a pool outside of the heap so heap engines
+*	can index every free block no matter its size.
+*
+*	Finding the lowest addressed free block of a given size reads one node per level and the tree 
+*	is around log16(n) levels deep, compared to the log2(n) scattered headers a heap tree walks. 
+*	Empty nodes are released but underfull nodes are never merged, so the tree stays valid without
+*	rebalancing on removal.
+*/
+class FreeBlockIndex
+{
+public:
+	/**
+	*	Constructs an empty free block index.
+	*/
+	FreeBlockIndex();
+
+	/**
+	*	Destroys a free block index.
+	*/
+	~FreeBlockIndex();
+
+	/**
+	*	Copying is undefined.
+	*/
+	FreeBlockIndex(const FreeBlockIndex &) = delete;
+
+	/**
+	*	Copying is undefined.
+	*/
+	FreeBlockIndex& operator=(const FreeBlockIndex &) = delete;
+
+	/**
+	*	Inserts a free block into the index.
+	*
+	*	@param index the index of the free block, must not be in the index
+	*	@param num_chunks the number of chunks in the free block
+	*/
+	void Insert(IndexType index, IndexType num_chunks);
+
+	/**
+	*	Removes a free block from the index.
+	*
+	*	@param index the index of the free block, must be in the index
+	*/
+	void Remove(IndexType index);
+
+	/**
+	*	Changes the size of a free block in the index.
+	*
+	*	@param index the index of the free block, must be in the index
+	*	@param num_chunks the new number of chunks in the free block
+	*/
+	void Resize(IndexType index, IndexType num_chunks);
+
+	/**
+	*	Finds the lowest addressed free block of desired size.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index, 0 if no free block is large enough
+	*/
+	IndexType FindFirstFit(IndexType num_chunks) const;
+
+	/**
+	*	Finds the highest addressed free block below the given index.
+	*
+	*	@param index the reference block index
+	*	@returns the free block index, 0 if there is no free block below the reference
+	*/
+	IndexType FindPrevious(IndexType index) const;
+
+	/**
+	*	Gets the number of chunks in an indexed free block.
+	*
+	*	@param index the index of the free block
+	*	@returns the number of chunks in the free block, 0 if the block is not in the index
+	*/
+	IndexType GetNumChunks(IndexType index) const;
+
+	/**
+	*	Gets the largest free block in the index.
+	*
+	*	@returns the number of chunks in the largest free block
+	*/
+	IndexType GetMaxNumChunks() const;
+
+	/**
+	*	Gets the number of free blocks in the index.
+	*
+	*	@returns the number of free blocks
+	*/
+	IndexType GetCount() const;
+
+	/**
+	*	Asserts the ordering, summaries and shape of the tree.
+	*/
+	void AssertInvariants() const;
+
+protected:
+
+	/**< The deepest a tree can get, enough for 2^31 free blocks in minimally split nodes. */
+	static const IndexType MAX_HEIGHT = 16;
+
+	/**
+	*	Descends to the leaf that holds, or would hold, the given index.
+	*
+	*	@param index the block index to find
+	*	@param path filled with the nodes from the root to the leaf
+	*	@param slots filled with the child slot taken at each inner node
+	*	@returns the depth of the leaf in the path
+	*/
+	IndexType Descend(IndexType index, IndexType *path, IndexType *slots) const;
+
+	/**
+	*	Splits any overflowing nodes on the path after an insertion, growing the tree if the root splits.
+	*
+	*	@param path the nodes from the root to the inserted leaf
+	*	@param slots the child slot taken at each inner node
+	*	@param depth the depth of the leaf in the path
+	*/
+	void SplitPath(IndexType *path, IndexType *slots, IndexType depth);
+
+	/**
+	*	Recalculates the child summaries from the given depth up to the root.
+	*
+	*	@param path the nodes from the root to a leaf
+	*	@param slots the child slot taken at each inner node
+	*	@param depth the depth of the deepest node that changed
+	*/
+	void UpdatePathStatistics(const IndexType *path, const IndexType *slots, IndexType depth);
+
+	/**
+	*	Gets the largest free block size recorded in a node.
+	*
+	*	@param node the node to inspect
+	*	@returns the largest entry in the node
+	*/
+	static IndexType GetNodeMax(const FreeBlockIndexNode &node);
+
+	/**
+	*	Inserts an entry into a node, shifting the entries after it.
+	*
+	*	@param node the node to insert into
+	*	@param slot the position of the new entry
+	*	@param key the key of the entry
+	*	@param num_chunks the size of the entry
+	*	@param child the child node of the entry, ignored in leaves
+	*/
+	static void InsertEntry(FreeBlockIndexNode &node, IndexType slot, IndexType key, IndexType num_chunks, IndexType child);
+
+	/**
+	*	Removes an entry from a node, shifting the entries after it.
+	*
+	*	@param node the node to remove from
+	*	@param slot the position of the entry
+	*/
+	static void RemoveEntry(FreeBlockIndexNode &node, IndexType slot);
+
+	/**
+	*	Takes a node from the pool, growing the pool if it is exhausted.
+	*
+	*	@param is_leaf is the new node a leaf
+	*	@returns the index of the empty node
+	*/
+	IndexType AllocateNode(bool is_leaf);
+
+	/**
+	*	Returns a node to the pool.
+	*
+	*	@param node the index of the node
+	*/
+	void ReleaseNode(IndexType node);
+
+	/**
+	*	Asserts invariants over a subtree.
+	*
+	*	@param node the root of the subtree
+	*	@param lower_bound the inclusive lower bound of the keys in the subtree
+	*	@param upper_bound the exclusive upper bound of the keys in the subtree
+	*	@param height the number of levels below the subtree root
+	*	@returns the number of free blocks in the subtree
+	*/
+	IndexType AssertSubtreeInvariants(IndexType node, IndexType lower_bound, IndexType upper_bound, IndexType height) const;
+
+	/**< The node pool, node 0 is never used so it can stand for no node. */
+	FreeBlockIndexNode *_nodes;
+
+	/**< The number of nodes in the pool. */
+	IndexType _capacity;
+
+	/**< The number of pool nodes that have ever been handed out, including node 0. */
+	IndexType _used;
+
+	/**< The head of the list of released nodes. */
+	IndexType _free_node;
+
+	/**< The root node of the tree. */
+	IndexType _root;
+
+	/**< The number of inner levels above the leaves. */
+	IndexType _height;
+
+	/**< The number of free blocks in the index. */
+	IndexType _count;
+
+	/**< The initial number of nodes in the pool. */
+	static const IndexType INITIAL_CAPACITY = 64;
+};
\ No newline at end of file
@@ -0,0 +1,807 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "FreeSplayHeap.h"
+#include "AlignedAllocator.h"
+
+#include "SIMDMem.h"
+
+#include <cassert>
+#include <new>
+#include <algorithm>
+
+#include <deque>
+
+#include "FreeSplayHeader.h"
+
+template <typename Policies>
+FreeSplayHeapEngine<Policies>::FreeSplayHeapEngine(size_t size, HeaderLayout layout)
+{
+	// Make sure heap size is multiples of 16 bytes
+	static const size_t mask = 16 - 1;
+	const auto offset = ( 16 - ( size & mask ) ) & mask;
+	const auto total_size = size + offset;
+	assert(total_size % 16 == 0);
+
+	// A heap of <64 bytes is undefined
+	assert(total_size >= 64);
+
+	// Get the total number of chunks we need
+	_num_chunks = total_size / 16;
+
+	// Can the total number of chunks be indexed bu a 31 bit unsigned integer.
+	assert(_num_chunks <= (IndexType(-1) >> 1));
+
+	// Allocate the system heap
+	// Out of band headers get their own array so payloads stay contiguous
+	_header_chunks = layout == INLINE_HEADERS ? 1 : 0;
+	_heap = static_cast<FreeSplayHeader*>(AlignedNew(total_size, 16));
+	_data = _header_chunks ? reinterpret_cast<HeapChunk*>(_heap) 
+		: static_cast<HeapChunk*>(AlignedNew(total_size, 16));
+
+	// Setup the null sentinel node
+	new (&_heap[NULL_INDEX]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED);
+
+	// Setup the splay header to a known initial state
+	new (&_heap[SPLAY_HEADER_INDEX]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED);
+
+	// Setup the root node
+	_root_index = 2;
+	_free_chunks = _num_chunks - 2; // Null, Splay, therefore -2
+	new (&_heap[_root_index]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, _free_chunks, FREE);
+	UpdateNodeStatistics(_heap[_root_index]);
+
+	_rover_index = _root_index;
+
+	// Debug set free chunks in the heap
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), INIT_PATTERN, GetBlockDataChunks(_root_index));
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::UpdateNodeStatistics(FreeSplayHeader &node)
+{
+	// Every node is a free block so the maximum is a 3 way maximum of children and self
+	assert(!node._block_metadata._is_allocated);
+	node._max_contiguous_free_chunks = std::max(
+		std::max(_heap[node._left]._max_contiguous_free_chunks, _heap[node._right]._max_contiguous_free_chunks),
+		IndexType(node._block_metadata._num_chunks));
+}
+
+template <typename Policies>
+FreeSplayHeapEngine<Policies>::~FreeSplayHeapEngine()
+{
+	AssertHeapInvariants();
+
+	_pointer_list.RemoveAll();
+
+	// Delete the system heap
+	if (static_cast<void*>(_data) != static_cast<void*>(_heap))
+		AlignedDelete(_data);
+
+	AlignedDelete(_heap);
+}
+
+template <typename Policies>
+HeapChunk* FreeSplayHeapEngine<Policies>::GetBlockData(IndexType index) const
+{
+	return &_data[index + _header_chunks];
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::GetBlockDataChunks(IndexType index) const
+{
+	return _heap[index]._block_metadata._num_chunks - _header_chunks;
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::SetBoundaryTag(IndexType index, IndexType prev_free_chunks)
+{
+	// The free block may end the heap
+	if (index >= _num_chunks)
+		return;
+
+	// Two free blocks are never adjacent so the next block is allocated
+	assert(_heap[index]._block_metadata._is_allocated);
+	_heap[index]._prev_free_chunks = prev_free_chunks;
+}
+
+template <typename Policies>
+float FreeSplayHeapEngine<Policies>::FragmentationRatio() const
+{
+	AssertHeapInvariants();
+
+	// Heap is not fragmented if we are at full load
+	if (!_free_chunks)
+		return 0.0f;
+
+	// Get free chunks statistics
+	const auto free = static_cast<float>(_free_chunks);
+	const auto free_max = static_cast<float>(_heap[_root_index]._max_contiguous_free_chunks);
+	
+	// Calculate free chunks ratio to determine fragmentation
+	return (free - free_max) / free;
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::RotateWithLeftChild( IndexType k2 )
+{
+	// Get left subtree
+	auto k1 = _heap[k2]._left;
+
+	// Bind nodes
+	auto &n1 = _heap [ k1 ];
+	auto &n2 = _heap [ k2 ];
+
+	// Move right subtree of left child
+	n2._left = n1._right;
+
+	// Lower original node
+	n1._right = k2;
+
+	// Update new child node statistics
+	UpdateNodeStatistics( n2 );
+
+	// Update new parent node statistics
+	UpdateNodeStatistics( n1 );
+
+	return k1;
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::RotateWithRightChild( IndexType k1 )
+{
+	// Promote right subtree
+	auto k2 = _heap[ k1 ]._right;
+
+	// Bind nodes
+	auto &n1 = _heap [ k1 ];
+	auto &n2 = _heap [ k2 ];
+
+	// Move left subtree of right child
+	n1._right = n2._left;
+
+	// Lower original node
+	n2._left = k1;
+
+	// Update new child node statistics
+	UpdateNodeStatistics( n1 );
+
+	// Update new parent node statistics
+	UpdateNodeStatistics( n2 );
+
+	return k2;
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const
+{
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Traverse down tree until we find a free block large enough
+	while ( t )
+	{
+		auto &n = _heap [ t ];
+
+		// Does the left subtree contain a free block large enough
+		if ( _heap [ n._left ]._max_contiguous_free_chunks >= num_chunks )
+			t = n._left;
+		// Is the current block big enough?
+		else if ( n._block_metadata._num_chunks >= num_chunks )
+			break;
+		// The right subtree must contain the free block
+		else
+			t = n._right;
+	}
+	
+	// Return found index
+	return t;
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy )
+{
+	assert(t == _root_index);
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Splay the rover to the root, the blocks after it are now the root and its right subtree
+	_root_index = Splay(_rover_index, t);
+	auto &root = _heap[_root_index];
+
+	// Is the root after the rover and big enough
+	if (_root_index >= _rover_index && root._block_metadata._num_chunks >= num_chunks)
+		return _root_index;
+
+	// Does the right subtree contain a free block large enough
+	if (_heap[root._right]._max_contiguous_free_chunks >= num_chunks)
+		return FindFreeBlock(root._right, num_chunks, FirstFitPolicy());
+
+	// Wrap around to the start of the heap
+	return FindFreeBlock(_root_index, num_chunks, FirstFitPolicy());
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::RemoveRoot()
+{
+	auto &root = _heap[_root_index];
+
+	// Without a left subtree the right subtree is the new tree
+	if (root._left == NULL_INDEX)
+	{
+		_root_index = root._right;
+		return;
+	}
+
+	// Splay the maximum of the left subtree up, it has no right subtree to replace
+	const auto right = root._right;
+	_root_index = Splay(_root_index, root._left);
+	_heap[_root_index]._right = right;
+	UpdateNodeStatistics(_heap[_root_index]);
+}
+
+template <typename Policies>
+IndexType FreeSplayHeapEngine<Policies>::Splay(IndexType value, IndexType t)
+{
+	assert(t != NULL_INDEX);
+
+	// Setup splay tracking state
+	new (&_heap[SPLAY_HEADER_INDEX]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED);
+	IndexType left_tree_max = SPLAY_HEADER_INDEX, right_tree_min = SPLAY_HEADER_INDEX;
+	IndexType last_splayed_node = SPLAY_HEADER_INDEX;
+
+	// Simulate a null node with a reassignable value
+	IndexType lut[] = { value, NULL_INDEX };
+	auto lookup = [&](IndexType v) { 
+		lut[1] = v;
+		return lut[v > 0]; 
+	};
+
+	// Continually rotate the tree until we splay the desired value
+	while (true)
+	{
+		// Is the desired value in the left subtree
+		if (value < lookup(t))
+		{
+			// If the desired value is in the left subtree of the left child
+			if (value < lookup(_heap[t]._left))
+				// Rotate left subtree up
+				t = RotateWithLeftChild(t);
+
+			auto &n = _heap[t];
+			auto &r = _heap[right_tree_min];
+
+			// If the desired value is now at the root, stop splay
+			if (n._left == NULL_INDEX)
+				break;
+
+			// t is now a minimum value
+			// Link right state tree
+			r._left = t;
+
+			// Add node to change list
+			_heap [ t ]._max_contiguous_free_chunks = last_splayed_node;
+			last_splayed_node = t;
+
+			// Advance splay tracking offsets
+			right_tree_min = t;
+			t = n._left;
+		}
+		// Is the desired value in the right subtree
+		else if (value > lookup(t))
+		{
+			// If the desired value is in the right subtree of the right child
+			if (value > lookup(_heap[t]._right))
+				// Rotate right subtree up
+				t = RotateWithRightChild(t);
+
+			auto &n = _heap[t];
+			auto &l = _heap[left_tree_max];
+
+			// If the desired value is now at the root, stop splay
+			if (n._right == NULL_INDEX)
+				break;
+
+			// t is now a maximum value
+			// Link left state tree
+			l._right = t;
+
+			// Add node to change list
+			_heap [ t ]._max_contiguous_free_chunks = last_splayed_node;
+			last_splayed_node = t;
+
+			// Advance splay tracking offsets
+			left_tree_max = t;
+			t = n._right;
+		}
+		// Is the desired value at the root
+		else
+			break;
+	}
+	
+	auto &n = _heap[t];
+	auto &l = _heap[left_tree_max];
+	auto &r = _heap[right_tree_min];
+
+	// Rebuild left and right subtrees
+	l._right = n._left;
+	r._left = n._right;
+
+	// Update statistics for nodes in changelist
+	while ( last_splayed_node != SPLAY_HEADER_INDEX )
+	{
+		// Remember next item in list
+		auto next = _heap [ last_splayed_node ]._max_contiguous_free_chunks;
+
+		// Update node statistics
+		UpdateNodeStatistics( _heap [ last_splayed_node ] );
+
+		// Go to next item
+		last_splayed_node = next;
+	}
+
+	// Rebuild tree root
+	n._left = _heap[SPLAY_HEADER_INDEX]._right;
+	n._right = _heap[SPLAY_HEADER_INDEX]._left;
+	UpdateNodeStatistics(n);
+
+	return t;
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock FreeSplayHeapEngine<Policies>::Allocate(size_t num_bytes)
+{
+	AssertHeapInvariants();
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunks(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock FreeSplayHeapEngine<Policies>::AllocateChunks(IndexType required_chunks)
+{
+	assert(required_chunks);
+
+	// Do we have enough contiguous space for the allocation
+	if (_heap[_root_index]._max_contiguous_free_chunks < required_chunks)
+		return nullptr;
+
+	// Splay the found free block to the root
+	const auto free_block = FindFreeBlock(_root_index, required_chunks, FitPolicy());
+	assert(free_block);
+	_root_index = Splay(free_block, _root_index);
+	AssertHeapInvariants();
+
+	/* Split the root free block into two, one allocated block and one free block */
+
+	auto &root = _heap[_root_index];
+	const auto free_chunks = root._block_metadata._num_chunks;
+	const auto raw_free_chunks = free_chunks - required_chunks;
+
+	// Is there a new free block to keep in the tree
+	if (raw_free_chunks)
+	{
+		// No other free block lies between the found block and the remainder
+		// so the remainder takes the place of the found block in the tree
+		const auto new_free_index = free_block + required_chunks;
+		new (&_heap[new_free_index]) FreeSplayHeader(root._left, root._right, raw_free_chunks, FREE);
+		UpdateNodeStatistics(_heap[new_free_index]);
+		_root_index = new_free_index;
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_free_index), SPLIT_PATTERN, GetBlockDataChunks(new_free_index));
+	}
+	else
+		RemoveRoot();
+
+	// The block after the found block now follows the remainder, or an allocated block
+	SetBoundaryTag(free_block + free_chunks, raw_free_chunks);
+
+	// Set the found block so that it represents a now allocated block
+	// The block before a free block is always allocated
+	new (&_heap[free_block]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, required_chunks, ALLOCATED);
+	_heap[free_block]._prev_free_chunks = 0;
+	_free_chunks -= required_chunks;
+
+	// Continue searching from after this allocation
+	if (FitPolicy::ROVING)
+		_rover_index = free_block + required_chunks;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(free_block), ALLOC_PATTERN, GetBlockDataChunks(free_block));
+
+	AssertHeapInvariants();
+
+	// Possible strict aliasing problem?
+	return _pointer_list.Create(GetBlockData(free_block));
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::Free(DefraggablePointerControlBlock& ptr)
+{
+	AssertHeapInvariants();
+	void* data = ptr.Get();
+
+	// We cannot free the null pointer
+	if (!data)
+		return;
+
+	// Get the offset of the pointer into the heap
+	const auto block_addr = static_cast<HeapChunk*>(data);
+	const std::ptrdiff_t offset = block_addr - _data;
+
+	// Is the offset in a valid range
+	if ( offset < ptrdiff_t( 2 + _header_chunks ) || offset >= ptrdiff_t( _num_chunks ) )
+		return;
+
+	// Is the data pointer of expected alignment
+	if (block_addr != &_data[offset])
+		return;
+
+	// Read the block header before it is rewritten as a free block
+	auto block = IndexType(offset) - _header_chunks;
+	assert(_heap[block]._block_metadata._is_allocated);
+	auto num_chunks = IndexType(_heap[block]._block_metadata._num_chunks);
+	const auto prev_free_chunks = _heap[block]._prev_free_chunks;
+	_free_chunks += num_chunks;
+
+	// Invalidate defraggable pointers that point into the block before we invalidate data in the heap
+	if (PointerPolicy::INVALIDATE_ALIASES)
+		_pointer_list.RemovePointersInRange(&_data[block], &_data[block + num_chunks]);
+	else
+		ptr = nullptr;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(block), FREED_PATTERN, num_chunks - _header_chunks);
+
+	// Is the next block free, it will be merged into the freed block
+	const auto next = block + num_chunks;
+	const bool next_free = next < _num_chunks && !_heap[next]._block_metadata._is_allocated;
+
+	// Is the previous block free, the boundary tag tells us where it starts
+	if (prev_free_chunks)
+	{
+		// Splay the previous free block to the root and grow it over the freed block
+		block -= prev_free_chunks;
+		_root_index = Splay(block, _root_index);
+		assert(_root_index == block);
+
+		auto &root = _heap[_root_index];
+		num_chunks += prev_free_chunks;
+
+		// The next free block is the successor of the root
+		if (next_free)
+		{
+			const auto successor = Splay(block, root._right);
+			assert(successor == next);
+
+			num_chunks += _heap[successor]._block_metadata._num_chunks;
+			root._right = _heap[successor]._right;
+		}
+
+		root._block_metadata._num_chunks = num_chunks;
+		UpdateNodeStatistics(root);
+	}
+	// Is the next block free, the freed block takes its place in the tree
+	else if (next_free)
+	{
+		_root_index = Splay(next, _root_index);
+		assert(_root_index == next);
+
+		auto &root = _heap[_root_index];
+		num_chunks += root._block_metadata._num_chunks;
+		new (&_heap[block]) FreeSplayHeader(root._left, root._right, num_chunks, FREE);
+		UpdateNodeStatistics(_heap[block]);
+		_root_index = block;
+	}
+	// Insert the freed block into the tree between its neighbours
+	else
+	{
+		new (&_heap[block]) FreeSplayHeader(NULL_INDEX, NULL_INDEX, num_chunks, FREE);
+
+		if (_root_index != NULL_INDEX)
+		{
+			_root_index = Splay(block, _root_index);
+			auto &root = _heap[_root_index];
+
+			// Split the tree around the nearest free block
+			if (_root_index < block)
+			{
+				_heap[block]._left = _root_index;
+				_heap[block]._right = root._right;
+				root._right = NULL_INDEX;
+			}
+			else
+			{
+				_heap[block]._left = root._left;
+				_heap[block]._right = _root_index;
+				root._left = NULL_INDEX;
+			}
+
+			UpdateNodeStatistics(root);
+		}
+
+		UpdateNodeStatistics(_heap[block]);
+		_root_index = block;
+	}
+
+	// Did we merge with a neighbour
+	if (DebugPolicy::FILL_PATTERNS && (prev_free_chunks || next_free))
+		SIMDMemSet(GetBlockData(block), MERGE_PATTERN, GetBlockDataChunks(block));
+
+	// Tag the block after the free block with its size
+	SetBoundaryTag(block + num_chunks, num_chunks);
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::FullDefrag()
+{
+	AssertHeapInvariants();
+	while (!IterateHeap())
+		;
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+bool FreeSplayHeapEngine<Policies>::IsFullyDefragmented() const
+{
+	AssertHeapInvariants();
+	return _heap[_root_index]._max_contiguous_free_chunks == _free_chunks;
+}
+
+template <typename Policies>
+bool FreeSplayHeapEngine<Policies>::IterateHeap()
+{
+	AssertHeapInvariants();
+	// Do we actually need to defrag the heap
+	if (IsFullyDefragmented())
+		return true;
+
+	// Splay the first free block in the heap to the root
+	const auto free_block = FindFreeBlock(_root_index, 1, FirstFitPolicy());
+	_root_index = Splay(free_block, _root_index);
+	AssertHeapInvariants();
+
+	auto &root = _heap[_root_index];
+	assert(root._left == NULL_INDEX);
+	const auto free_chunks = root._block_metadata._num_chunks;
+
+	// Our heap invariant means the next block must be allocated
+	const auto right = free_block + free_chunks;
+	assert(_heap[right]._block_metadata._is_allocated);
+	const auto moved_chunks = _heap[right]._block_metadata._num_chunks;
+
+	// Update defraggable pointers before invalidating the heap
+	_pointer_list.OffsetPointersInRange(&_data[right], &_data[right + moved_chunks], (ptrdiff_t(free_block) - ptrdiff_t(right)) * 16);
+
+	// The free block after the moved block is the successor of the root, absorb it
+	auto new_free_chunks = free_chunks;
+	auto new_free_right = root._right;
+	const auto next = right + moved_chunks;
+	if (next < _num_chunks && !_heap[next]._block_metadata._is_allocated)
+	{
+		const auto successor = Splay(free_block, root._right);
+		assert(successor == next);
+
+		new_free_chunks += _heap[successor]._block_metadata._num_chunks;
+		new_free_right = _heap[successor]._right;
+	}
+
+	// Create new allocated block header, the block before it is still allocated
+	FreeSplayHeader new_allocated(NULL_INDEX, NULL_INDEX, moved_chunks, ALLOCATED);
+	new_allocated._prev_free_chunks = 0;
+
+	// Create new free block header, it keeps the place of the old free block in the tree
+	FreeSplayHeader new_free(NULL_INDEX, new_free_right, new_free_chunks, FREE);
+	const auto new_free_offset = free_block + moved_chunks;
+
+	/* CONSIDER THE HEAP INVALID FROM HERE */
+
+	// Copy new allocated block header and move the data
+	SIMDMemCopy(&_heap[free_block], &new_allocated, 1);
+	SIMDMemCopy(GetBlockData(free_block), &_data[right + _header_chunks], moved_chunks - _header_chunks);
+
+	// Copy new free block header
+	SIMDMemCopy(&_heap[new_free_offset], &new_free, 1);
+
+	/* HEAP IS NOW VALID */
+
+	UpdateNodeStatistics(_heap[new_free_offset]);
+	_root_index = new_free_offset;
+	SetBoundaryTag(new_free_offset + new_free_chunks, new_free_chunks);
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), MOVE_PATTERN, GetBlockDataChunks(_root_index));
+
+	AssertHeapInvariants();
+
+	return IsFullyDefragmented( );
+}
+
+template <typename Policies>
+void FreeSplayHeapEngine<Policies>::AssertHeapInvariants() const
+{
+#ifdef NDEBUG
+	// We don't want to call this in release code
+	return;
+#endif
+
+	// The debug policy may opt out of invariant checking
+	if (!DebugPolicy::CHECK_INVARIANTS)
+		return;
+
+	/**
+	*	Free splay heap uses a null sentinel node to simplify some heap operations.
+	*/
+	{
+		// Assert that the first block is the null node, is allocated and is one chunk large
+		assert(_heap[NULL_INDEX]._left == NULL_INDEX);
+		assert(_heap[NULL_INDEX]._right == NULL_INDEX);
+		assert(_heap[NULL_INDEX]._block_metadata._is_allocated);
+		assert(_heap[NULL_INDEX]._block_metadata._num_chunks == 1);
+		assert(_heap[NULL_INDEX]._max_contiguous_free_chunks == 0);
+	}
+
+	/**
+	*	Free splay heap uses a splay header to perform top down splays. 
+	*/
+	{
+		// Assert that the second block is the header, is allocated and is one chunk large
+		assert(_heap[SPLAY_HEADER_INDEX]._block_metadata._is_allocated);
+		assert(_heap[SPLAY_HEADER_INDEX]._block_metadata._num_chunks == 1);
+
+		/* The children of the splay header may be arbitrary values. */
+	}
+
+	/**
+	*	Free splay heap uses block sizes to track position in the heap. The sum of all the metadata block sizes should be the raw size of the heap.
+	*/
+	{
+		IndexType size = 0;
+		while (size < _num_chunks)
+		{
+			// Add block size to sum
+			size += _heap[size]._block_metadata._num_chunks;
+		}
+
+		// Assert size invariant
+		assert(size == _num_chunks);
+	}
+
+	/**
+	*	Free splay heap follows the defraggable heap property that there are no two contiguous blocks free blocks.
+	*	Every allocated block carries a boundary tag with the size of the free block before it.
+	*/
+	{
+		IndexType prev = SPLAY_HEADER_INDEX;
+		IndexType current = 2;
+		while (current < _num_chunks)
+		{
+			const auto &p = _heap[prev];
+			const auto &n = _heap[current];
+
+			// Asert invariants
+			if (!n._block_metadata._is_allocated)
+				assert(p._block_metadata._is_allocated);
+			else
+				assert(n._prev_free_chunks == (p._block_metadata._is_allocated ? 0 : p._block_metadata._num_chunks));
+
+			// Go to next block
+			prev = current;
+			current += n._block_metadata._num_chunks;
+		}
+	}
+
+	/**
+	*	Free splay heap tracks the total number of free chunks in the heap. This should be the sum of all the free block sizes.
+	*/
+	{
+		IndexType size = 0;
+		IndexType index = 0;
+		while (index < _num_chunks)
+		{
+			// Add block size to sum
+			if (!_heap[index]._block_metadata._is_allocated)
+				size += _heap[index]._block_metadata._num_chunks;
+
+			index += _heap[index]._block_metadata._num_chunks;
+		}
+
+		// Assert size invariant
+		assert(size == _free_chunks);
+	}
+
+	/**
+	*	Free splay heap uses a tree structure to manage free blocks. An inorder traversal should visit every free block in address order,
+	*	and every node should hold the maximum free block of its subtree.
+	*/
+	{
+		// Skip to the first free block
+		IndexType current = 2;
+		while (current < _num_chunks && _heap[current]._block_metadata._is_allocated)
+			current += _heap[current]._block_metadata._num_chunks;
+
+		// Perform inorder traversal
+		std::deque<IndexType> tree;
+		IndexType node = _root_index;
+		while (node || !tree.empty())
+		{
+			if (node)
+			{
+				tree.push_back(node);
+				node = _heap[node]._left;
+				continue;
+			}
+
+			// Visit last node on stack
+			node = tree.back();
+			tree.pop_back();
+
+			// Assert that the current positions match in the heap
+			assert(current == node);
+
+			// Assert the cached maximum matches the children
+			const auto &n = _heap[node];
+			assert(!n._block_metadata._is_allocated);
+			assert(n._max_contiguous_free_chunks == std::max(
+				std::max(_heap[n._left]._max_contiguous_free_chunks, _heap[n._right]._max_contiguous_free_chunks),
+				IndexType(n._block_metadata._num_chunks)));
+
+			// Advance to the next free block in the heap
+			current += n._block_metadata._num_chunks;
+			while (current < _num_chunks && _heap[current]._block_metadata._is_allocated)
+				current += _heap[current]._block_metadata._num_chunks;
+
+			// Advance down right subtree
+			node = n._right;
+		}
+
+		// Every free block was visited
+		assert(current >= _num_chunks);
+	}
+}
+
+// Instantiate the engine for the supported policy combinations
+// Best fit keeps its size index in the splay heap only
+INSTANTIATE_HEAP_ENGINE_FOR_FIT(FreeSplayHeapEngine, FirstFitPolicy)
+INSTANTIATE_HEAP_ENGINE_FOR_FIT(FreeSplayHeapEngine, NextFitPolicy)
\ No newline at end of file
@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "BasicDefraggableHeap.h"
+#include "DefraggablePointerList.h"
+#include "HeapCommon.h"
+#include "HeapPolicies.h"
+
+struct FreeSplayHeader;
+
+/**
+*	A defraggable heap engine implemented as a splay tree over the free blocks only.
+*	Tree operations scale with the number of free blocks instead of the number of blocks,
+*	neighbouring blocks are found through block sizes and boundary tags.
+*
+*	@tparam Policies the HeapPolicies bundle the engine is compiled for
+*/
+template <typename Policies>
+class FreeSplayHeapEngine
+{
+
+public:
+
+	typedef typename Policies::FitPolicy FitPolicy;
+	typedef typename Policies::PointerPolicy PointerPolicy;
+	typedef typename Policies::DebugPolicy DebugPolicy;
+
+	/**
+	*	Constructs a free splay heap.
+	*
+	*	@param size the size of the heap in bytes.
+	*	@param layout where the block headers should be stored
+	*/
+	FreeSplayHeapEngine(size_t size, HeaderLayout layout = INLINE_HEADERS);
+
+	/**
+	*	Destroys a free splay heap.
+	*/
+	~FreeSplayHeapEngine();
+
+	/**
+	*	Allocates from the free splay heap. Always 16 byte aligned.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes);
+
+	/**
+	*	Frees the given heap data. Invalidates all defraggable pointers
+	*	pointing into the free block, or only the given pointer if the 
+	*	pointer policy does not track aliases.
+	*
+	*	@param ptr pointer into block in heap to free
+	*/
+	void Free(DefraggablePointerControlBlock &ptr);
+
+	/**
+	*	Fully Defragments the heap.
+	*/
+	void FullDefrag();
+
+	/**
+	*	Iterates the defragmentation process on the heap.
+	*	Heap is still valid for use after a call to this method. 
+	*
+	*	@returns true if the heap is now fully defragmented
+	*/
+	bool IterateHeap();
+
+	/**
+	*	Gets the fragmentation ratio of the heap.
+	*
+	*	@returns 0 if no fragmentation, 1 if fully fragmented
+	*/
+	float FragmentationRatio() const;
+
+	/**
+	*	Gets if the heap is fully defragmented.
+	*
+	*	@returns true if fully defragmented, false if there is fragmentation
+	*/
+	bool IsFullyDefragmented() const;
+
+protected:
+
+	/**
+	*	Allocates a block of the given number of chunks, including the header.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunks(IndexType required_chunks);
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size.
+	*
+	*	@param t the node to start the search at
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const;
+
+	/**
+	*	Finds the first free heap block of desired size after the rover, wrapping around
+	*	to the start of the heap. Splays the nearest free block to the rover to the root of the tree.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy );
+
+	/**
+	*	Removes the root free block from the tree.
+	*/
+	void RemoveRoot();
+
+	/**
+	*	Splays the given value, or the nearest free block to it, to the root of the tree.
+	*
+	*	@param value the node to splay
+	*	@param t the node to start the splay from
+	*/
+	IndexType Splay(IndexType value, IndexType t);
+
+	/**
+	*	Updates the node statistics of a given node.
+	*
+	*	@param node the node to update the statistics for
+	*/
+	void UpdateNodeStatistics( FreeSplayHeader &node );
+
+	/**
+	*	Rotates the given tree node with its left child.
+	*
+	*	@param k2 the node to rotate
+	*	@returns the index of the new parent
+	*/
+	IndexType RotateWithLeftChild(IndexType k2);
+
+	/**
+	*	Rotates the given tree node with its right child.
+	*
+	*	@param k2 the node to rotate
+	*	@returns the index of the new parent
+	*/
+	IndexType RotateWithRightChild(IndexType k1);
+
+	/**
+	*	Sets the boundary tag of the block following a free block.
+	*
+	*	@param index the index of the block after the free block
+	*	@param prev_free_chunks the number of chunks in the free block, 0 if it is no longer free
+	*/
+	void SetBoundaryTag(IndexType index, IndexType prev_free_chunks);
+
+	/**
+	*	Gets the payload address of the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the address of the first payload chunk
+	*/
+	HeapChunk* GetBlockData(IndexType index) const;
+
+	/**
+	*	Gets the number of payload chunks in the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the number of chunks not used by the block header
+	*/
+	IndexType GetBlockDataChunks(IndexType index) const;
+
+	/**
+	*	Asserts invariants over the heap.
+	*/
+	void AssertHeapInvariants() const;
+
+	/**< The block headers we manage, indexed by chunk. */
+	FreeSplayHeader* _heap;
+
+	/**< The payload chunks we manage. Aliases the headers when they are stored inline. */
+	HeapChunk* _data;
+
+	/**< The number of chunks each block spends on its header. */
+	IndexType _header_chunks;
+
+	/**< The number of chunks in the heap. */
+	IndexType _num_chunks;
+
+	/**< The root of the splay tree of free blocks, the null index if there are none. */
+	IndexType _root_index;
+
+	/**< The total number of free chunks in the heap. */
+	IndexType _free_chunks;
+
+	/**< The end of the last allocation, where roving fit policies start searching. */
+	IndexType _rover_index;
+
+	/**< The list of defraggable pointers for this heap. */
+	DefraggablePointerList _pointer_list;
+
+	/**< The offset of the null sentinel node into the heap. */
+	static const IndexType NULL_INDEX = 0;
+
+	/**< The offset of the splay header node into the heap. */
+	static const IndexType SPLAY_HEADER_INDEX = 1;
+};
+
+/**
+*	A defraggable heap implemented as a splay tree over the free blocks with the default policies.
+*/
+typedef BasicDefraggableHeap<FreeSplayHeapEngine> FreeSplayHeap;
\ No newline at end of file
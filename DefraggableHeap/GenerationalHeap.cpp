@@ -0,0 +1,273 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "GenerationalHeap.h"
+#include "AlignedAllocator.h"
+
+#include "SIMDMem.h"
+
+#include <cassert>
+
+NurseryHeader::NurseryHeader(IndexType num_chunks)
+	: _age(0)
+{
+	_block_metadata._is_allocated = ALLOCATED;
+	_block_metadata._num_chunks = num_chunks;
+	_unused[0] = _unused[1] = 0;
+}
+
+GenerationalHeap::GenerationalHeap(size_t nursery_size, size_t old_size, IndexType promotion_age)
+	: _old(old_size)
+	, _bump_index(0)
+	, _free_chunks(0)
+	, _promotion_age(promotion_age)
+{
+	// Make sure nursery size is multiples of 16 bytes
+	static const size_t mask = 16 - 1;
+	const auto offset = (16 - (nursery_size & mask)) & mask;
+	const auto total_size = nursery_size + offset;
+	assert(total_size % 16 == 0);
+
+	// A block needs a header and a payload chunk
+	assert(total_size >= 32);
+
+	// Can the total number of chunks be indexed bu a 31 bit unsigned integer.
+	_nursery_chunks = IndexType(total_size / 16);
+	assert(total_size / 16 <= (IndexType(-1) >> 1));
+
+	// A block has to survive at least one collection to be promoted
+	assert(_promotion_age);
+
+	_nursery = static_cast<HeapChunk*>(AlignedNew(total_size, 16));
+}
+
+GenerationalHeap::~GenerationalHeap()
+{
+	// Invalidate the pointers into the nursery before it goes away
+	_old._pointer_list.RemovePointersInRange(&_nursery[0], &_nursery[_nursery_chunks]);
+	AlignedDelete(_nursery);
+}
+
+DefraggablePointerControlBlock GenerationalHeap::Allocate(size_t num_bytes)
+{
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const size_t required_chunks = (num_bytes + offset) / 16 + 1;
+
+	// Blocks larger than the nursery start out in the old generation
+	if (required_chunks > _nursery_chunks)
+		return _old.Allocate(num_bytes);
+
+	// Make room by collecting the nursery, if the survivors still leave no room fall back to the old generation
+	if (_bump_index + required_chunks > _nursery_chunks)
+	{
+		Collect();
+
+		if (_bump_index + required_chunks > _nursery_chunks)
+			return _old.Allocate(num_bytes);
+	}
+
+	// Bump allocate the block off the top of the nursery
+	const IndexType index = _bump_index;
+	new (&_nursery[index]) NurseryHeader(IndexType(required_chunks));
+	_bump_index += IndexType(required_chunks);
+
+	return _old._pointer_list.Create(&_nursery[index + 1]);
+}
+
+void GenerationalHeap::Free(DefraggablePointerControlBlock &ptr)
+{
+	void* data = ptr.Get();
+
+	// Freeing a null pointer does nothing
+	if (!data)
+		return;
+
+	// Blocks outside the nursery belong to the old generation
+	if (!IsInNursery(data))
+	{
+		_old.Free(ptr);
+		return;
+	}
+
+	// Get the block the pointer points into
+	const auto *payload = static_cast<HeapChunk*>(data);
+	assert(payload > _nursery);
+	const IndexType index = IndexType(payload - _nursery) - 1;
+	auto &header = reinterpret_cast<NurseryHeader&>(_nursery[index]);
+	assert(header._block_metadata._is_allocated == ALLOCATED);
+	const IndexType num_chunks = header._block_metadata._num_chunks;
+
+	// Invalidate all pointers to the block
+	_old._pointer_list.RemovePointersInRange(&_nursery[index], &_nursery[index + num_chunks]);
+	header._block_metadata._is_allocated = FREE;
+
+	// A block at the top of the nursery is handed straight back to the bump allocator
+	if (index + num_chunks == _bump_index)
+		_bump_index = index;
+	else
+		_free_chunks += num_chunks;
+}
+
+void GenerationalHeap::Collect()
+{
+	// Reserve old generation blocks for the blocks that reached the promotion age
+	// Promotion stops at the first block the old generation cannot fit, those stay in the nursery
+	_promotions.clear();
+	for (IndexType index = 0; index < _bump_index; index += reinterpret_cast<NurseryHeader&>(_nursery[index])._block_metadata._num_chunks)
+	{
+		const auto &header = reinterpret_cast<NurseryHeader&>(_nursery[index]);
+		if (header._block_metadata._is_allocated == FREE || header._age + 1 < _promotion_age)
+			continue;
+
+		auto target = _old.Allocate((header._block_metadata._num_chunks - 1) * 16);
+		if (!target)
+			break;
+
+		_promotions.push_back(std::move(target));
+	}
+
+	// Describe where every block goes, promoted blocks move into the old generation
+	// and a run of surviving blocks slides down by the same offset
+	_relocations.clear();
+	size_t num_promoted = 0;
+	IndexType new_index = 0;
+	bool in_run = false;
+	for (IndexType index = 0; index < _bump_index; index += reinterpret_cast<NurseryHeader&>(_nursery[index])._block_metadata._num_chunks)
+	{
+		const auto &header = reinterpret_cast<NurseryHeader&>(_nursery[index]);
+		const intptr_t lower_bound = intptr_t(&_nursery[index]);
+
+		if (header._block_metadata._is_allocated == FREE)
+		{
+			// Freed blocks hold no pointers, the next survivor starts a new run
+			in_run = false;
+		}
+		else if (header._age + 1 >= _promotion_age && num_promoted < _promotions.size())
+		{
+			const intptr_t target = intptr_t(_promotions[num_promoted++].Get());
+			_relocations.push_back({ lower_bound, target - intptr_t(&_nursery[index + 1]) });
+			in_run = false;
+		}
+		else
+		{
+			if (!in_run)
+				_relocations.push_back({ lower_bound, (intptr_t(new_index) - intptr_t(index)) * 16 });
+			in_run = true;
+			new_index += header._block_metadata._num_chunks;
+		}
+	}
+
+	// Fix up all pointers into or stored in the nursery in one pass before any data moves
+	_old._pointer_list.RelocatePointersInRange(&_nursery[0], &_nursery[_bump_index], _relocations.data(), _relocations.size());
+
+	// Copy promoted blocks out and slide survivors down in address order
+	// A survivor never lands above its old position, so the headers still to be read stay intact
+	num_promoted = 0;
+	new_index = 0;
+	IndexType run_index = 0;
+	IndexType run_chunks = 0;
+	for (IndexType index = 0; index < _bump_index;)
+	{
+		auto &header = reinterpret_cast<NurseryHeader&>(_nursery[index]);
+		const IndexType num_chunks = header._block_metadata._num_chunks;
+		const bool survives = header._block_metadata._is_allocated == ALLOCATED &&
+			(header._age + 1 < _promotion_age || num_promoted >= _promotions.size());
+
+		if (survives)
+		{
+			// Age the survivor and grow the run it belongs to
+			header._age++;
+			if (!run_chunks)
+				run_index = index;
+			run_chunks += num_chunks;
+		}
+		else
+		{
+			// Slide the pending run of survivors down in one copy
+			if (run_chunks && run_index != new_index)
+				SIMDMemCopy(&_nursery[new_index], &_nursery[run_index], run_chunks);
+			new_index += run_chunks;
+			run_chunks = 0;
+
+			// Copy the payload of a promoted block into its old generation block
+			if (header._block_metadata._is_allocated == ALLOCATED)
+				SIMDMemCopy(_promotions[num_promoted++].Get(), &_nursery[index + 1], num_chunks - 1);
+		}
+
+		index += num_chunks;
+	}
+
+	// Slide the last run of survivors down
+	if (run_chunks && run_index != new_index)
+		SIMDMemCopy(&_nursery[new_index], &_nursery[run_index], run_chunks);
+	new_index += run_chunks;
+
+	// The promoted blocks are owned by the relocated pointers now
+	_promotions.clear();
+
+	_bump_index = new_index;
+	_free_chunks = 0;
+}
+
+bool GenerationalHeap::IterateHeap()
+{
+	Collect();
+	return IsFullyDefragmented();
+}
+
+void GenerationalHeap::FullDefrag()
+{
+	Collect();
+	_old.FullDefrag();
+}
+
+float GenerationalHeap::FragmentationRatio() const
+{
+	return _old.FragmentationRatio();
+}
+
+bool GenerationalHeap::IsFullyDefragmented() const
+{
+	return !_free_chunks && _old.IsFullyDefragmented();
+}
+
+SplayHeap& GenerationalHeap::GetOldGeneration()
+{
+	return _old;
+}
+
+bool GenerationalHeap::IsInNursery(void* data) const
+{
+	return data >= static_cast<void*>(&_nursery[0]) && data < static_cast<void*>(&_nursery[_bump_index]);
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include "DefraggablePointerList.h"
+#include "HeapCommon.h"
+#include "SplayHeap.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+*	The header of a block in the nursery of a generational heap.
+*/
+struct NurseryHeader
+{
+	/**
+	*	Constructs a nursery header.
+	*
+	*	@param num_chunks the number of chunks in the block (including the header)
+	*/
+	NurseryHeader(IndexType num_chunks);
+
+	/**< The metadata of the block. */
+	BlockMetadata _block_metadata;
+
+	/**< The number of collections the block has survived in the nursery. */
+	IndexType _age;
+
+	/**< Pads the header to a full chunk. */
+	IndexType _unused[2];
+};
+
+static_assert(sizeof(NurseryHeader) == 16, "A nursery header needs to be 16 bytes in size.");
+
+/**
+*	A defraggable heap split into two generations. New blocks are bump allocated in a nursery,
+*	which is compacted by sliding its survivors down in one pass. Blocks that survive a number of
+*	collections are promoted into an old generation splay heap, so long lived blocks stop being moved.
+*	Both generations share the pointer list of the old generation, so pointers stored in blocks of
+*	either generation are fixed up wherever the blocks they point to or live in move.
+*/
+class GenerationalHeap
+{
+public:
+
+	/**
+	*	Constructs a generational heap.
+	*
+	*	@param nursery_size the size of the nursery in bytes
+	*	@param old_size the size of the old generation in bytes
+	*	@param promotion_age the number of collections a block survives before it is promoted
+	*/
+	GenerationalHeap(size_t nursery_size, size_t old_size, IndexType promotion_age = 2);
+
+	/**
+	*	Destroys a generational heap.
+	*/
+	~GenerationalHeap();
+
+	/**
+	*	Copying is undefined.
+	*/
+	GenerationalHeap(const GenerationalHeap &) = delete;
+
+	/**
+	*	Copying is undefined.
+	*/
+	GenerationalHeap& operator=(const GenerationalHeap &) = delete;
+
+	/**
+	*	Allocates a block of memory of the given size, in the nursery unless it only fits in the old generation.
+	*
+	*	@param num_bytes the number of bytes to allocate
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes);
+
+	/**
+	*	Frees the block the defraggable pointer points to, in whichever generation it lives.
+	*
+	*	@param ptr the pointer to free
+	*/
+	void Free(DefraggablePointerControlBlock &ptr);
+
+	/**
+	*	Compacts the nursery, promoting blocks that reached the promotion age into the old generation.
+	*/
+	void Collect();
+
+	/**
+	*	Collects the nursery. The old generation is left to its auto defrag policy,
+	*	so long lived blocks are only moved once it becomes too fragmented.
+	*
+	*	@returns true if the heap is fully defragmented
+	*/
+	bool IterateHeap();
+
+	/**
+	*	Collects the nursery and fully defragments the old generation.
+	*/
+	void FullDefrag();
+
+	/**
+	*	Gets the fragmentation ratio of the old generation, the nursery is compact after every collection.
+	*
+	*	@returns 0 if no fragmentation, 1 if fully fragmented
+	*/
+	float FragmentationRatio() const;
+
+	/**
+	*	Gets if the nursery holds no freed blocks and the old generation is fully defragmented.
+	*
+	*	@returns true if fully defragmented, false if there is fragmentation
+	*/
+	bool IsFullyDefragmented() const;
+
+	/**
+	*	Gets the old generation.
+	*
+	*	@returns the old generation heap
+	*/
+	SplayHeap& GetOldGeneration();
+
+protected:
+
+	/**
+	*	Gets if an address lies in the nursery blocks.
+	*
+	*	@param data the address to test
+	*	@returns true if the address lies in the nursery
+	*/
+	bool IsInNursery(void* data) const;
+
+	/**< The old generation that promoted blocks live in. */
+	SplayHeap _old;
+
+	/**< The nursery memory. */
+	HeapChunk* _nursery;
+
+	/**< The number of chunks in the nursery. */
+	IndexType _nursery_chunks;
+
+	/**< The first chunk past the last nursery block, the next block is bump allocated there. */
+	IndexType _bump_index;
+
+	/**< The number of freed chunks below the bump index. */
+	IndexType _free_chunks;
+
+	/**< The number of collections a block survives before it is promoted. */
+	IndexType _promotion_age;
+
+	/**< The old generation blocks reserved for the promotions of the current collection, kept to reuse their storage. */
+	std::vector<DefraggablePointerControlBlock> _promotions;
+
+	/**< The relocations of the current collection, kept to reuse their storage. */
+	std::vector<PointerRelocation> _relocations;
+};
\ No newline at end of file
@@ -59,6 +59,109 @@ struct BlockMetadata
 
 static_assert(sizeof(BlockMetadata) == sizeof(IndexType), "The metadata field must be the size of the index type.");
 
+/**
+*	The layouts a defraggable heap can store its block headers in.
+*/
+enum HeaderLayout : IndexType
+{
+	/**< Headers live in the chunk directly preceding the block payload. */
+	INLINE_HEADERS = 0,
+
+	/**< Headers live in a separate array indexed by chunk, payloads are fully contiguous. */
+	OUT_OF_BAND_HEADERS = 1
+};
+
+/**
+*	How long an allocation is expected to live. Heaps place short lived blocks apart from long lived ones,
+*	so blocks that are freed together leave holes next to each other.
+*/
+enum LifetimeHint : IndexType
+{
+	/**< The block outlives most others, it is placed from the bottom of the heap. */
+	LONG_LIVED = 0,
+
+	/**< The block is freed soon, it is placed from the top of the heap. */
+	SHORT_LIVED = 1
+};
+
+/**
+*	A plan for compacting a window of adjacent blocks into one free block, with what it costs to carry out.
+*	Plans are iterated by the heap that made them, the heap stays usable in between.
+*/
+struct DefragPlan
+{
+	/**
+	*	Constructs a plan for the given window that moves nothing.
+	*
+	*	@param begin the first chunk of the window
+	*	@param end the chunk after the end of the window
+	*/
+	DefragPlan(IndexType begin = 0, IndexType end = 0)
+		: _begin(begin), _end(end), _free_chunks(0), _move_chunks(0), _move_blocks(0), _move_runs(0)
+	{
+
+	}
+
+	/**< The first chunk of the window the plan compacts. */
+	IndexType _begin;
+
+	/**< The chunk after the end of the window the plan compacts. */
+	IndexType _end;
+
+	/**< The number of free chunks the plan gathers into one free block. */
+	IndexType _free_chunks;
+
+	/**< The number of live chunks the plan moves, 16 bytes each. */
+	IndexType _move_chunks;
+
+	/**< The number of allocated blocks the plan moves, each has at least one defraggable pointer to fix up. */
+	IndexType _move_blocks;
+
+	/**< The number of runs of allocated blocks the plan slides, each is one pass over the defraggable pointers. */
+	IndexType _move_runs;
+};
+
+/**
+*	Configures when a heap defragments itself at the end of Allocate and Free.
+*	Defragmentation starts once the fragmentation ratio rises above the start ratio and carries on
+*	until it falls to the stop ratio, so the heap does not toggle around a single threshold.
+*/
+struct AutoDefragPolicy
+{
+	/**
+	*	Constructs a policy, the default never defragments.
+	*
+	*	@param start_ratio the fragmentation ratio above which defragmentation starts
+	*	@param stop_ratio the fragmentation ratio at or below which defragmentation stops
+	*	@param budget the number of defragmentation iterations each Allocate or Free may do
+	*/
+	AutoDefragPolicy(float start_ratio = 1.0f, float stop_ratio = 0.0f, size_t budget = 0)
+		: _start_ratio(start_ratio), _stop_ratio(stop_ratio), _budget(budget)
+	{
+
+	}
+
+	/**< The fragmentation ratio above which defragmentation starts. */
+	float _start_ratio;
+
+	/**< The fragmentation ratio at or below which defragmentation stops. */
+	float _stop_ratio;
+
+	/**< The number of defragmentation iterations each Allocate or Free may do. */
+	size_t _budget;
+};
+
+/**
+*	Defines a raw 16 byte chunk of heap payload memory.
+*/
+_declspec(align(16)) struct HeapChunk
+{
+	/**< The raw bytes of the chunk. */
+	uint8_t _bytes[16];
+};
+
+static_assert(sizeof(HeapChunk) == 16, "A heap chunk needs to be 16 bytes in size.");
+
 
 /**< The pattern initial blocks should be set to */
 const int INIT_PATTERN = 0x12345678;
@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+/**
+*	Fit policy that allocates from the lowest addressed free block that is large enough.
+*/
+struct FirstFitPolicy
+{
+	/**< Does the policy keep a roving cursor at the last allocation. */
+	static const bool ROVING = false;
+
+	/**< Does the policy pick the smallest free block that is large enough. */
+	static const bool BEST_FIT = false;
+
+	/**< Does the policy search an address ordered index of free blocks kept outside the heap. */
+	static const bool INDEXED = false;
+
+	/**< Is the index a packed array scanned with SIMD rather than a B+ tree. */
+	static const bool PACKED = false;
+};
+
+/**
+*	Fit policy that allocates from the first free block that is large enough after the last allocation,
+*	wrapping around to the start of the heap.
+*/
+struct NextFitPolicy
+{
+	/**< Does the policy keep a roving cursor at the last allocation. */
+	static const bool ROVING = true;
+
+	/**< Does the policy pick the smallest free block that is large enough. */
+	static const bool BEST_FIT = false;
+
+	/**< Does the policy search an address ordered index of free blocks kept outside the heap. */
+	static const bool INDEXED = false;
+
+	/**< Is the index a packed array scanned with SIMD rather than a B+ tree. */
+	static const bool PACKED = false;
+};
+
+/**
+*	Fit policy that allocates from the smallest free block that is large enough, 
+*	breaking ties on the lowest address. Engines keep a size ordered index of free blocks for it.
+*/
+struct BestFitPolicy
+{
+	/**< Does the policy keep a roving cursor at the last allocation. */
+	static const bool ROVING = false;
+
+	/**< Does the policy pick the smallest free block that is large enough. */
+	static const bool BEST_FIT = true;
+
+	/**< Does the policy search an address ordered index of free blocks kept outside the heap. */
+	static const bool INDEXED = false;
+
+	/**< Is the index a packed array scanned with SIMD rather than a B+ tree. */
+	static const bool PACKED = false;
+};
+
+/**
+*	Fit policy that allocates from the lowest addressed free block that is large enough, found through
+*	a cache conscious B+ tree of free blocks instead of the heap's own block structure.
+*/
+struct IndexedFirstFitPolicy
+{
+	/**< Does the policy keep a roving cursor at the last allocation. */
+	static const bool ROVING = false;
+
+	/**< Does the policy pick the smallest free block that is large enough. */
+	static const bool BEST_FIT = false;
+
+	/**< Does the policy search an address ordered index of free blocks kept outside the heap. */
+	static const bool INDEXED = true;
+
+	/**< Is the index a packed array scanned with SIMD rather than a B+ tree. */
+	static const bool PACKED = false;
+};
+
+/**
+*	Fit policy that allocates from the lowest addressed free block that is large enough, found by a SIMD scan
+*	over a packed array of free block sizes instead of chasing the heap's own links.
+*/
+struct PackedFirstFitPolicy
+{
+	/**< Does the policy keep a roving cursor at the last allocation. */
+	static const bool ROVING = false;
+
+	/**< Does the policy pick the smallest free block that is large enough. */
+	static const bool BEST_FIT = false;
+
+	/**< Does the policy search an address ordered index of free blocks kept outside the heap. */
+	static const bool INDEXED = true;
+
+	/**< Is the index a packed array scanned with SIMD rather than a B+ tree. */
+	static const bool PACKED = true;
+};
+
+/**
+*	Pointer policy that invalidates every defraggable pointer into a block when it is freed.
+*	Freeing is linear in the number of live defraggable pointers.
+*/
+struct SharedPointerPolicy
+{
+	/**< Should freeing a block invalidate all pointers aliasing the block. */
+	static const bool INVALIDATE_ALIASES = true;
+};
+
+/**
+*	Pointer policy that only invalidates the defraggable pointer that was freed.
+*	The caller guarantees no other defraggable pointer aliases a freed block.
+*/
+struct UniquePointerPolicy
+{
+	/**< Should freeing a block invalidate all pointers aliasing the block. */
+	static const bool INVALIDATE_ALIASES = false;
+};
+
+/**
+*	Debug policy that fills blocks with debug patterns and checks heap invariants.
+*/
+struct FullDebugPolicy
+{
+	/**< Should block payloads be set to the debug patterns. */
+	static const bool FILL_PATTERNS = true;
+
+	/**< Should heap invariants be asserted on every operation. */
+	static const bool CHECK_INVARIANTS = true;
+};
+
+/**
+*	Debug policy that performs no debug work in the heap operations.
+*/
+struct NoDebugPolicy
+{
+	/**< Should block payloads be set to the debug patterns. */
+	static const bool FILL_PATTERNS = false;
+
+	/**< Should heap invariants be asserted on every operation. */
+	static const bool CHECK_INVARIANTS = false;
+};
+
+/**
+*	The debug policy heaps use when none is specified.
+*/
+#ifdef NDEBUG
+typedef NoDebugPolicy DefaultDebugPolicy;
+#else
+typedef FullDebugPolicy DefaultDebugPolicy;
+#endif
+
+/**
+*	Bundles the compile time policies of a defraggable heap so engines take a single parameter.
+*
+*	@tparam Fit the policy used to pick a free block for an allocation
+*	@tparam Pointer the policy used to track defraggable pointers
+*	@tparam Debug the policy used for debug fills and invariant checks
+*/
+template <typename Fit, typename Pointer, typename Debug>
+struct HeapPolicies
+{
+	typedef Fit FitPolicy;
+	typedef Pointer PointerPolicy;
+	typedef Debug DebugPolicy;
+};
+
+/**
+*	Explicitly instantiates a heap engine for every supported policy combination.
+*	Engines keep their definitions in their source file, so a combination must be listed here to be usable.
+*/
+#define INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, Fit) \
+	template class Engine<HeapPolicies<Fit, SharedPointerPolicy, FullDebugPolicy>>; \
+	template class Engine<HeapPolicies<Fit, SharedPointerPolicy, NoDebugPolicy>>; \
+	template class Engine<HeapPolicies<Fit, UniquePointerPolicy, FullDebugPolicy>>; \
+	template class Engine<HeapPolicies<Fit, UniquePointerPolicy, NoDebugPolicy>>;
+
+#define INSTANTIATE_HEAP_ENGINE(Engine) \
+	INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, FirstFitPolicy) \
+	INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, NextFitPolicy) \
+	INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, BestFitPolicy) \
+	INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, IndexedFirstFitPolicy) \
+	INSTANTIATE_HEAP_ENGINE_FOR_FIT(Engine, PackedFirstFitPolicy)
\ No newline at end of file
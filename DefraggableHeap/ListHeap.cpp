@@ -39,9 +39,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <iterator>
 #include <set>
+#include <thread>
 #include <vector>
 
-ListHeap::ListHeap(size_t size)
+template <typename Policies>
+ListHeapEngine<Policies>::ListHeapEngine(size_t size, HeaderLayout layout)
 {
 	// Make sure heap size is multiples of 16 bytes
 	static const size_t mask = 16 - 1;
@@ -59,7 +61,11 @@ ListHeap::ListHeap(size_t size)
 	assert(_num_chunks <= (IndexType(-1) >> 1));
 
 	// Allocate the system heap
+	// Out of band headers get their own array so payloads stay contiguous
+	_header_chunks = layout == INLINE_HEADERS ? 1 : 0;
 	_heap = static_cast<ListHeader*>(AlignedNew(total_size, 16));
+	_data = _header_chunks ? reinterpret_cast<HeapChunk*>(_heap)
+		: static_cast<HeapChunk*>(AlignedNew(total_size, 16));
 
 	// Setup the null sentinel node
 	new (&_heap[NULL_INDEX]) ListHeader(NULL_INDEX, 1, 1, 1, ALLOCATED);
@@ -68,23 +74,47 @@ ListHeap::ListHeap(size_t size)
 	const auto free = _num_chunks - 1;
 	new (&_heap[1]) ListHeader(NULL_INDEX, NULL_INDEX, NULL_INDEX, free, FREE);
 
+	if (FitPolicy::INDEXED)
+		_free_index.Insert(1, free);
+
 	// Setup heap tracking state
 	_free_chunks = free;
+	_max_hole_chunks = 0;
+	_max_hole_count = 0;
+	_rover_index = 1;
+	_defrag_on_allocate_failure = false;
 
 	AssertHeapInvariants();
 }
 
-ListHeap::~ListHeap()
+template <typename Policies>
+ListHeapEngine<Policies>::~ListHeapEngine()
 {
 	AssertHeapInvariants();
 
 	_pointer_list.RemoveAll();
 
 	// Delete the system heap
+	if (static_cast<void*>(_data) != static_cast<void*>(_heap))
+		AlignedDelete(_data);
+
 	AlignedDelete(_heap);
 }
 
-float ListHeap::FragmentationRatio() const
+template <typename Policies>
+HeapChunk* ListHeapEngine<Policies>::GetBlockData(IndexType index) const
+{
+	return &_data[index + _header_chunks];
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::GetBlockDataChunks(IndexType index) const
+{
+	return _heap[index]._block_metadata._num_chunks - _header_chunks;
+}
+
+template <typename Policies>
+float ListHeapEngine<Policies>::FragmentationRatio() const
 {
 	AssertHeapInvariants();
 
@@ -93,18 +123,19 @@ float ListHeap::FragmentationRatio() const
 	if (!_free_chunks)
 		return 0.0f;
 
-	// Get free chunks statistics
+	// Get free chunks statistics, the index already tracks the largest free block
+	// Otherwise the largest free block is either the largest hole or the wilderness at the end of the heap
 	IndexType max_contiguous_free_chunks = 0;
-	IndexType t = _heap[NULL_INDEX]._next_free;
-
-	while (t != NULL_INDEX)
+	if (FitPolicy::INDEXED)
+		max_contiguous_free_chunks = _free_index.GetMaxNumChunks();
+	else
 	{
-		assert(!_heap[t]._block_metadata._is_allocated);
-
-		max_contiguous_free_chunks = std::max(max_contiguous_free_chunks,
-			_heap[t]._block_metadata._num_chunks);
+		max_contiguous_free_chunks = GetMaxHoleChunks();
 
-		t = _heap[t]._next_free;
+		const auto wilderness = _heap[NULL_INDEX]._prev_free;
+		const auto wilderness_chunks = _heap[wilderness]._block_metadata._num_chunks;
+		if (wilderness != NULL_INDEX && wilderness + wilderness_chunks == _num_chunks)
+			max_contiguous_free_chunks = std::max(max_contiguous_free_chunks, wilderness_chunks);
 	}
 
 	const auto free_max = static_cast<float>(max_contiguous_free_chunks);
@@ -115,7 +146,8 @@ float ListHeap::FragmentationRatio() const
 }
 
 
-bool ListHeap::IsFullyDefragmented() const
+template <typename Policies>
+bool ListHeapEngine<Policies>::IsFullyDefragmented() const
 {
 	AssertHeapInvariants();
 
@@ -123,7 +155,8 @@ bool ListHeap::IsFullyDefragmented() const
 	return _heap[NULL_INDEX]._next_free == _heap[NULL_INDEX]._prev_free;
 }
 
-IndexType ListHeap::FindFreeBlock( IndexType num_chunks) const
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindFreeBlock( IndexType num_chunks, FirstFitPolicy ) const
 {
 	AssertHeapInvariants();
 
@@ -144,7 +177,119 @@ IndexType ListHeap::FindFreeBlock( IndexType num_chunks) const
 	return block;
 }
 
-DefraggablePointerControlBlock ListHeap::Allocate(size_t num_bytes)
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindFreeBlock( IndexType num_chunks, NextFitPolicy ) const
+{
+	AssertHeapInvariants();
+
+	// Start searching at the rover
+	IndexType block = _rover_index;
+
+	// Iterate through the rest of the freelist until we find a block big enough
+	while (block != NULL_INDEX &&
+		_heap[block]._block_metadata._num_chunks < num_chunks)
+	{
+		assert(!_heap[block]._block_metadata._is_allocated);
+
+		// Advance the list index
+		block = _heap[block]._next_free;
+	}
+
+	// Did we find a block after the rover
+	if (block != NULL_INDEX)
+		return block;
+
+	// Wrap around to the first non null node and search up to the rover
+	block = _heap[NULL_INDEX]._next_free;
+	while (block != _rover_index &&
+		_heap[block]._block_metadata._num_chunks < num_chunks)
+	{
+		assert(!_heap[block]._block_metadata._is_allocated);
+
+		// Advance the list index
+		block = _heap[block]._next_free;
+	}
+
+	// The rover was already searched
+	return block != _rover_index ? block : NULL_INDEX;
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindFreeBlock( IndexType num_chunks, BestFitPolicy ) const
+{
+	AssertHeapInvariants();
+
+	// Start at the first non null node
+	IndexType block = _heap[NULL_INDEX]._next_free;
+	IndexType best_block = NULL_INDEX;
+
+	// Iterate through the whole freelist keeping the smallest block big enough
+	while (block != NULL_INDEX)
+	{
+		assert(!_heap[block]._block_metadata._is_allocated);
+
+		const auto block_chunks = _heap[block]._block_metadata._num_chunks;
+		if (block_chunks >= num_chunks && 
+			(best_block == NULL_INDEX || block_chunks < _heap[best_block]._block_metadata._num_chunks))
+		{
+			best_block = block;
+
+			// An exact fit cannot be beaten
+			if (block_chunks == num_chunks)
+				break;
+		}
+
+		// Advance the list index
+		block = _heap[block]._next_free;
+	}
+
+	// Return the found block
+	return best_block;
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindFreeBlock( IndexType num_chunks, IndexedFirstFitPolicy ) const
+{
+	AssertHeapInvariants();
+
+	// The index reads a few cache lines instead of a header per free block
+	const auto block = _free_index.FindFirstFit(num_chunks);
+	assert(block == FindFreeBlock(num_chunks, FirstFitPolicy()));
+
+	return block;
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindFreeBlock( IndexType num_chunks, PackedFirstFitPolicy ) const
+{
+	// The packed index answers through the same interface
+	return FindFreeBlock(num_chunks, IndexedFirstFitPolicy());
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindLastFreeBlock( IndexType num_chunks ) const
+{
+	AssertHeapInvariants();
+
+	// Start searching at the last non null node
+	IndexType block = _heap[NULL_INDEX]._prev_free;
+
+	// Iterate backwards through the freelist until we find a block big enough
+	while (block != NULL_INDEX &&
+		_heap[block]._block_metadata._num_chunks < num_chunks)
+	{
+		assert(!_heap[block]._block_metadata._is_allocated);
+
+		// Advance the list index
+		block = _heap[block]._prev_free;
+	}
+
+	// Return the found block
+	return block;
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock ListHeapEngine<Policies>::Allocate(size_t num_bytes)
 {
 	AssertHeapInvariants();
 
@@ -155,17 +300,111 @@ DefraggablePointerControlBlock ListHeap::Allocate(size_t num_bytes)
 	// Calculate the number of chunks required to fulfil the request
 	const IndexType mask = 16 - 1;
 	const IndexType offset = (16 - (num_bytes & mask)) & mask;
-	const IndexType required_chunks = ((num_bytes + offset) / 16) + 1;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunks(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock ListHeapEngine<Policies>::Allocate(size_t num_bytes, LifetimeHint hint)
+{
+	// Long lived blocks are placed by the fit policy
+	if (hint == LONG_LIVED)
+		return Allocate(num_bytes);
+
+	AssertHeapInvariants();
+
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const IndexType mask = 16 - 1;
+	const IndexType offset = (16 - (num_bytes & mask)) & mask;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunksFromTop(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock ListHeapEngine<Policies>::AllocateChunks(IndexType required_chunks)
+{
 	assert(required_chunks);
 
-	// Try find a suitable free block
-	const auto found_block = FindFreeBlock(required_chunks);
-	auto &block = _heap[found_block];
+	// The wilderness is the free block at the end of the heap, if there is one
+	const auto wilderness = _heap[NULL_INDEX]._prev_free;
+	const bool has_wilderness = wilderness != NULL_INDEX &&
+		wilderness + _heap[wilderness]._block_metadata._num_chunks == _num_chunks;
+
+	// If no hole below the wilderness can fit the allocation, bump it off the wilderness
+	// The wilderness is always the highest addressed block so this respects first fit
+	IndexType found_block = NULL_INDEX;
+	if (has_wilderness && 
+		(required_chunks > _max_hole_chunks || _heap[NULL_INDEX]._next_free == wilderness) &&
+		_heap[wilderness]._block_metadata._num_chunks >= required_chunks)
+	{
+		found_block = wilderness;
+	}
+	else
+	{
+		// Try find a suitable free block
+		found_block = FindFreeBlock(required_chunks, FitPolicy());
+
+		// Did the search pass every hole without finding a fit
+		// Roving searches may have skipped the holes before the rover, best fit ones may pass over larger holes
+		if (found_block == NULL_INDEX || 
+			(!FitPolicy::ROVING && !FitPolicy::BEST_FIT && has_wilderness && found_block == wilderness))
+			LowerMaxHoleChunks(required_chunks - 1);
+	}
 
 	// Did we fail to find a suitable free block
 	if (found_block == NULL_INDEX)
-		return nullptr;
-	
+	{
+		// Is there enough free space in total to make room for the allocation
+		if (!_defrag_on_allocate_failure || _free_chunks < required_chunks)
+			return nullptr;
+
+		DefragForAllocation(required_chunks);
+		return AllocateChunks(required_chunks);
+	}
+
+	AllocateBlock(found_block, required_chunks);
+
+	// Possible strict aliasing problem?
+	return _pointer_list.Create(GetBlockData(found_block));
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock ListHeapEngine<Policies>::AllocateChunksFromTop(IndexType required_chunks)
+{
+	assert(required_chunks);
+
+	// Try find a suitable free block, the top free block usually fits
+	const auto found_block = FindLastFreeBlock(required_chunks);
+
+	// Did we fail to find a suitable free block
+	if (found_block == NULL_INDEX)
+	{
+		// Is there enough free space in total to make room for the allocation
+		if (!_defrag_on_allocate_failure || _free_chunks < required_chunks)
+			return nullptr;
+
+		DefragForAllocation(required_chunks);
+		return AllocateChunksFromTop(required_chunks);
+	}
+
+	const auto block = AllocateBlockFromTop(found_block, required_chunks);
+
+	return _pointer_list.Create(GetBlockData(block));
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::AllocateBlock(IndexType found_block, IndexType required_chunks)
+{
+	auto &block = _heap[found_block];
+	assert(!block._block_metadata._is_allocated);
+	assert(block._block_metadata._num_chunks >= required_chunks);
+
 	/* Split the free block into two, one allocated block and one free block */
 
 	// Calculate the new raw free block size
@@ -173,15 +412,15 @@ DefraggablePointerControlBlock ListHeap::Allocate(size_t num_bytes)
 		- required_chunks;
 
 	// Remove the found block from the freelist
+	RemoveHole(found_block);
 	const auto prev_free = RemoveFreeBlock(found_block);
 
 	// Set the found block so that it represents a now allocated block
 	block._block_metadata = { ALLOCATED, required_chunks };
 	_free_chunks -= required_chunks;
 
-#ifdef _DEBUG
-		SIMDMemSet(&block + 1, ALLOC_PATTERN, block._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(found_block), ALLOC_PATTERN, GetBlockDataChunks(found_block));
 
 	// Is there a new free block to add back to the list
 	if (raw_free_chunks)
@@ -202,24 +441,79 @@ DefraggablePointerControlBlock ListHeap::Allocate(size_t num_bytes)
 
 		// Insert new free block into the free list
 		InsertFreeBlock(prev_free, new_free_index);
+		AddHole(new_free_index);
+
+		// Continue searching from after this allocation
+		if (FitPolicy::ROVING)
+			_rover_index = new_free_index;
 
 		// Restore previous cycle of heap
 		IndexType next = new_free_index + _heap[new_free_index]._block_metadata._num_chunks;
 		if (next < _num_chunks)
 			_heap[next]._prev = new_free_index;
 
-#ifdef _DEBUG
-			SIMDMemSet(&_heap[new_free_index + 1], SPLIT_PATTERN, _heap[new_free_index]._block_metadata._num_chunks - 1);
-#endif
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_free_index), SPLIT_PATTERN, GetBlockDataChunks(new_free_index));
 	}
 
 	AssertHeapInvariants();
+}
 
-	// Possible strict aliasing problem?
-	return _pointer_list.Create(&block + 1);
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::AllocateBlockFromTop(IndexType found_block, IndexType required_chunks)
+{
+	auto &block = _heap[found_block];
+	assert(!block._block_metadata._is_allocated);
+	assert(block._block_metadata._num_chunks >= required_chunks);
+
+	// Calculate the number of chunks left free below the allocation
+	const auto raw_free_chunks = block._block_metadata._num_chunks
+		- required_chunks;
+
+	// An exact fit takes the whole block
+	if (!raw_free_chunks)
+	{
+		AllocateBlock(found_block, required_chunks);
+		return found_block;
+	}
+
+	/* Shrink the free block in place, it keeps its place in the free list */
+
+	RemoveHole(found_block);
+	block._block_metadata._num_chunks = raw_free_chunks;
+	_free_chunks -= required_chunks;
+
+	if (FitPolicy::INDEXED)
+		_free_index.Resize(found_block, raw_free_chunks);
+
+	// Create the header for the allocated block above it
+	const auto new_block = found_block + raw_free_chunks;
+	new (&_heap[new_block]) ListHeader(
+		found_block,
+		NULL_INDEX,
+		NULL_INDEX,
+		required_chunks,
+		ALLOCATED
+		);
+
+	// An allocated block now follows the free block, so it is a hole even if it was the wilderness
+	AddHole(found_block);
+
+	// Restore previous cycle of heap
+	IndexType next = new_block + required_chunks;
+	if (next < _num_chunks)
+		_heap[next]._prev = new_block;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(new_block), ALLOC_PATTERN, GetBlockDataChunks(new_block));
+
+	AssertHeapInvariants();
+
+	return new_block;
 }
 
-IndexType ListHeap::RemoveFreeBlock(IndexType index)
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::RemoveFreeBlock(IndexType index)
 {
 	assert(!_heap[index]._block_metadata._is_allocated);
 
@@ -227,14 +521,22 @@ IndexType ListHeap::RemoveFreeBlock(IndexType index)
 	auto &block = _heap[index];
 	const auto prev_free = block._prev_free;
 
+	// Keep the rover on a block in the free list
+	if (FitPolicy::ROVING && _rover_index == index)
+		_rover_index = block._next_free;
+
 	// Remove the block from the free list
 	_heap[block._next_free]._prev_free = prev_free;
 	_heap[block._prev_free]._next_free = block._next_free;
 
+	if (FitPolicy::INDEXED)
+		_free_index.Remove(index);
+
 	return prev_free;
 }
 
-void ListHeap::InsertFreeBlock(IndexType root, IndexType index)
+template <typename Policies>
+void ListHeapEngine<Policies>::InsertFreeBlock(IndexType root, IndexType index)
 {
 	assert(!_heap[root]._block_metadata._is_allocated || root == NULL_INDEX);
 	assert(!_heap[index]._block_metadata._is_allocated);
@@ -255,9 +557,13 @@ void ListHeap::InsertFreeBlock(IndexType root, IndexType index)
 	// Modify backwards chain in list
 	i._prev_free = root;
 	n._prev_free = index;
+
+	if (FitPolicy::INDEXED)
+		_free_index.Insert(index, i._block_metadata._num_chunks);
 }
 
-void ListHeap::Free(DefraggablePointerControlBlock &ptr)
+template <typename Policies>
+void ListHeapEngine<Policies>::Free(DefraggablePointerControlBlock &ptr)
 {
 	AssertHeapInvariants();
 
@@ -268,33 +574,49 @@ void ListHeap::Free(DefraggablePointerControlBlock &ptr)
 		return;
 
 	// Get the offset of the pointer into the heap
-	const auto block_addr = static_cast<ListHeader*>(data);
-	const std::ptrdiff_t offset = block_addr - _heap;
+	const auto block_addr = static_cast<HeapChunk*>(data);
+	const std::ptrdiff_t offset = block_addr - _data;
 
 	// Is the offset in a valid range
-	if (offset < 0 || offset >= _num_chunks)
+	if (offset < ptrdiff_t(_header_chunks) || offset >= ptrdiff_t(_num_chunks))
 		return;
 
 	// Is the data pointer of expected alignment
-	if (block_addr != &_heap[offset])
+	if (block_addr != &_data[offset])
 		return;
 
+	// Invalidate defraggable pointers that point into the block before we invalidate data in the heap
+	const auto new_offset = IndexType(offset) - _header_chunks;
+	if (PointerPolicy::INVALIDATE_ALIASES)
+		_pointer_list.RemovePointersInRange(&_data[new_offset], &_data[new_offset + _heap[new_offset]._block_metadata._num_chunks]);
+	else
+		ptr = nullptr;
+
+	FreeBlock(new_offset, FindNearestFreeBlock(new_offset));
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::FreeBlock(IndexType new_offset, IndexType prev_free)
+{
 	// Mark the block as being free
-	const auto new_offset = offset - 1;
 	auto &block = _heap[new_offset];
+	assert(block._block_metadata._is_allocated);
 	block._block_metadata._is_allocated = FREE;
 	_free_chunks += block._block_metadata._num_chunks;
 
+	// The free neighbours the block merges with stop being holes of their own
+	const auto next_block = new_offset + block._block_metadata._num_chunks;
+	if (next_block < _num_chunks && !_heap[next_block]._block_metadata._is_allocated)
+		RemoveHole(next_block);
+
+	if (!_heap[block._prev]._block_metadata._is_allocated)
+		RemoveHole(block._prev);
+
 	// Insert now free block into the freelist
-	const auto prev_free = FindNearestFreeBlock(new_offset);
 	InsertFreeBlock(prev_free, new_offset);
 
-	// Invalidate defraggable pointers that point into the root block before we invalidate data in the heap
-	_pointer_list.RemovePointersInRange(&block, &block + block._block_metadata._num_chunks);
-
-#ifdef _DEBUG
-	SIMDMemSet(&block + 1, FREED_PATTERN, block._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(new_offset), FREED_PATTERN, GetBlockDataChunks(new_offset));
 
 	// Track which nodes we modify last so we can restore the heap invariants
 	IndexType last_modified_node = new_offset;
@@ -312,20 +634,17 @@ void ListHeap::Free(DefraggablePointerControlBlock &ptr)
 		RemoveFreeBlock(block._next_free);
 
 		// Grow the current free block 
-		block._block_metadata._num_chunks += next._block_metadata._num_chunks;
+		GrowFreeBlock(new_offset, next._block_metadata._num_chunks);
 
-#ifdef _DEBUG
-		SIMDMemSet(&block + 1, MERGE_PATTERN, block._block_metadata._num_chunks - 1);
-#endif
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_offset), MERGE_PATTERN, GetBlockDataChunks(new_offset));
 	}
 
 	// Does the left heap contain any potential free blocks
 	if (block._prev_free == block._prev &&
 		block._prev_free != NULL_INDEX)
 	{
-		// Bind the previous block
-		auto &prev = _heap[block._prev_free];
-		assert(!prev._block_metadata._is_allocated);
+		assert(!_heap[block._prev_free]._block_metadata._is_allocated);
 
 		// Remove the block from the free list
 		RemoveFreeBlock(new_offset);
@@ -336,14 +655,13 @@ void ListHeap::Free(DefraggablePointerControlBlock &ptr)
 			_heap[next_offset]._prev = block._prev;
 
 		// Grow the previous free block 
-		prev._block_metadata._num_chunks += block._block_metadata._num_chunks;
+		GrowFreeBlock(block._prev_free, block._block_metadata._num_chunks);
 
 		// Update which node we modified last
 		last_modified_node = block._prev_free;
 
-#ifdef _DEBUG
-		SIMDMemSet(&prev + 1, MERGE_PATTERN, prev._block_metadata._num_chunks - 1);
-#endif
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(block._prev_free), MERGE_PATTERN, GetBlockDataChunks(block._prev_free));
 	}
 
 	// Restore previous cycle of heap
@@ -351,11 +669,97 @@ void ListHeap::Free(DefraggablePointerControlBlock &ptr)
 	if (next < _num_chunks)
 		_heap[next]._prev = last_modified_node;
 
+	AddHole(last_modified_node);
+
 	AssertHeapInvariants();
 }
 
-IndexType ListHeap::FindNearestFreeBlock(IndexType index) const
+template <typename Policies>
+void ListHeapEngine<Policies>::GrowFreeBlock(IndexType index, IndexType num_chunks)
+{
+	assert(!_heap[index]._block_metadata._is_allocated);
+
+	_heap[index]._block_metadata._num_chunks += num_chunks;
+
+	if (FitPolicy::INDEXED)
+		_free_index.Resize(index, _heap[index]._block_metadata._num_chunks);
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::AddHole(IndexType index)
 {
+	// The wilderness is not a hole
+	const auto num_chunks = _heap[index]._block_metadata._num_chunks;
+	if (index + num_chunks == _num_chunks)
+		return;
+
+	if (num_chunks > _max_hole_chunks)
+	{
+		_max_hole_chunks = num_chunks;
+		_max_hole_count = 1;
+	}
+	else if (num_chunks == _max_hole_chunks)
+		++_max_hole_count;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::RemoveHole(IndexType index)
+{
+	// The wilderness is not a hole
+	const auto num_chunks = _heap[index]._block_metadata._num_chunks;
+	if (index + num_chunks == _num_chunks)
+		return;
+
+	// Once the last known hole of the largest size goes the bound is left as an upper bound
+	if (num_chunks == _max_hole_chunks && _max_hole_count)
+		--_max_hole_count;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::LowerMaxHoleChunks(IndexType num_chunks)
+{
+	if (num_chunks >= _max_hole_chunks)
+		return;
+
+	// How many holes have the lower size is not known
+	_max_hole_chunks = num_chunks;
+	_max_hole_count = 0;
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::GetMaxHoleChunks() const
+{
+	// Is the bound still the exact size of the largest hole
+	if (_max_hole_count || !_max_hole_chunks)
+		return _max_hole_chunks;
+
+	// The largest holes were allocated or merged away, find the new largest hole and keep it for later calls
+	_max_hole_chunks = 0;
+	for (IndexType t = _heap[NULL_INDEX]._next_free; t != NULL_INDEX; t = _heap[t]._next_free)
+	{
+		const auto num_chunks = _heap[t]._block_metadata._num_chunks;
+		if (t + num_chunks == _num_chunks)
+			continue;
+
+		if (num_chunks > _max_hole_chunks)
+		{
+			_max_hole_chunks = num_chunks;
+			_max_hole_count = 1;
+		}
+		else if (num_chunks == _max_hole_chunks)
+			++_max_hole_count;
+	}
+
+	return _max_hole_chunks;
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::FindNearestFreeBlock(IndexType index) const
+{
+	// The index answers in a walk down the tree instead of along the list
+	if (FitPolicy::INDEXED)
+		return _free_index.FindPrevious(index);
+
 	// Start searching at the first non null node
 	IndexType block = _heap[NULL_INDEX]._next_free;
 
@@ -373,7 +777,8 @@ IndexType ListHeap::FindNearestFreeBlock(IndexType index) const
 	return _heap[block]._prev_free;
 }
 
-void ListHeap::FullDefrag()
+template <typename Policies>
+void ListHeapEngine<Policies>::FullDefrag()
 {
 	AssertHeapInvariants();
 
@@ -384,7 +789,8 @@ void ListHeap::FullDefrag()
 }
 
 
-bool ListHeap::IterateHeap()
+template <typename Policies>
+bool ListHeapEngine<Policies>::IterateHeap()
 {
 	AssertHeapInvariants();
 
@@ -393,42 +799,66 @@ bool ListHeap::IterateHeap()
 		return true;
 
 	// Get the first free block in the heap
-	auto free_block = _heap[NULL_INDEX]._next_free;
-	auto &f = _heap[free_block];
+	const auto free_block = _heap[NULL_INDEX]._next_free;
 	assert(free_block != NULL_INDEX);
-	assert(!f._block_metadata._is_allocated);
 
 	// If the next block points out of the heap, we are fully defragmented
-	auto alloc_block = free_block + f._block_metadata._num_chunks;
-	
-	if (alloc_block == _num_chunks)
+	if (free_block + _heap[free_block]._block_metadata._num_chunks == _num_chunks)
 		return true;
 
-	// Bind the next allocated block in the heap
-	auto &a = _heap[alloc_block];
-	assert(a._block_metadata._is_allocated);
+	SlideRun(free_block);
+
+	return IsFullyDefragmented();
+}
+
+template <typename Policies>
+IndexType ListHeapEngine<Policies>::SlideRun(IndexType free_block)
+{
+	auto &f = _heap[free_block];
+	assert(!f._block_metadata._is_allocated);
+
+	const auto alloc_block = free_block + f._block_metadata._num_chunks;
+	assert(alloc_block < _num_chunks);
+
+	// Find the end of the run of allocated blocks after the free block, the whole run moves at once
+	const auto shift = f._block_metadata._num_chunks;
+	auto run_end = alloc_block;
+	while (run_end < _num_chunks && _heap[run_end]._block_metadata._is_allocated)
+		run_end += _heap[run_end]._block_metadata._num_chunks;
+
+	assert(run_end != alloc_block);
 
 	// Remove freeblock from the free list
+	RemoveHole(free_block);
 	const auto prev_free = RemoveFreeBlock(free_block);
+	const auto prev_block = f._prev;
 
-	// Update defraggable pointers before invalidating the heap
-	_pointer_list.OffsetPointersInRange(&a, &a + a._block_metadata._num_chunks, (ptrdiff_t(free_block) - ptrdiff_t(alloc_block)) * 16);
+	// Update defraggable pointers before invalidating the heap, one pass for the whole run
+	_pointer_list.OffsetPointersInRange(&_data[alloc_block], &_data[run_end], -ptrdiff_t(shift) * 16);
 
 	// Create new free block header
-	ListHeader new_free(free_block, NULL_INDEX, NULL_INDEX, f._block_metadata._num_chunks, FREE);
-	const auto new_free_offset = free_block + a._block_metadata._num_chunks;
-
-	// Create new allocated block header
-	ListHeader new_allocated(f._prev, NULL_INDEX, NULL_INDEX, a._block_metadata._num_chunks, ALLOCATED);
+	const auto new_free_offset = run_end - shift;
+	ListHeader new_free(NULL_INDEX, NULL_INDEX, NULL_INDEX, shift, FREE);
 
 	/* CONSIDER THE HEAP INVALID FROM HERE */
 
-	// Copy new allocated block header and move the data
-	SIMDMemCopy(&f, &new_allocated, 1);
-	SIMDMemCopy(&f + 1, &a + 1,
-		new_allocated._block_metadata._num_chunks - 1);
+	// Move the run down in one copy, inline headers move along with their data
+	SIMDMemCopy(&_data[free_block], &_data[alloc_block], run_end - alloc_block);
+
+	// Patch the moved headers in a single pass, out of band headers are moved here too
+	IndexType prev = prev_block;
+	for (IndexType index = free_block; index < new_free_offset; index += _heap[index]._block_metadata._num_chunks)
+	{
+		if (!_header_chunks)
+			_heap[index] = _heap[index + shift];
+
+		assert(_heap[index]._block_metadata._is_allocated);
+		_heap[index]._prev = prev;
+		prev = index;
+	}
 
 	// Copy new free block header
+	new_free._prev = prev;
 	SIMDMemCopy(&_heap[new_free_offset], &new_free, 1);
 
 	/* HEAP IS NOW VALID */
@@ -436,9 +866,8 @@ bool ListHeap::IterateHeap()
 	// Add new free block to the free list
 	InsertFreeBlock(prev_free, new_free_offset);
 
-#ifdef _DEBUG
-	SIMDMemSet(&_heap[new_free_offset + 1], MOVE_PATTERN, _heap[new_free_offset]._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(new_free_offset), MOVE_PATTERN, GetBlockDataChunks(new_free_offset));
 
 	// We possibly invalidated our heap invariant
 	// Does the right heap contain any potential free blocks
@@ -451,14 +880,14 @@ bool ListHeap::IterateHeap()
 		assert(!next._block_metadata._is_allocated);
 
 		// Remove the next block from the free list
+		RemoveHole(block._next_free);
 		RemoveFreeBlock(block._next_free);
 
 		// Grow the current free block 
-		block._block_metadata._num_chunks += next._block_metadata._num_chunks;
+		GrowFreeBlock(new_free_offset, next._block_metadata._num_chunks);
 
-#ifdef _DEBUG
-		SIMDMemSet(&block + 1, MERGE_PATTERN, block._block_metadata._num_chunks - 1);
-#endif
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_free_offset), MERGE_PATTERN, GetBlockDataChunks(new_free_offset));
 	}
 
 	// Restore previous cycle of heap
@@ -466,18 +895,374 @@ bool ListHeap::IterateHeap()
 	if (node < _num_chunks)
 		_heap[node]._prev = new_free_offset;
 
+	AddHole(new_free_offset);
+
+	AssertHeapInvariants();
+
+	return new_free_offset;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::SetDefragOnAllocateFailure(bool enable)
+{
+	_defrag_on_allocate_failure = enable;
+}
+
+template <typename Policies>
+DefragPlan ListHeapEngine<Policies>::PlanDefrag(size_t num_bytes) const
+{
+	AssertHeapInvariants();
+
+	// Calculate the number of chunks an allocation of the given size needs
+	// A full compaction gathers every free chunk in the heap
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const auto required_chunks = num_bytes ? std::min<size_t>((num_bytes + offset) / 16 + _header_chunks, _free_chunks) : _free_chunks;
+
+	// An empty plan is already complete
+	if (!required_chunks)
+		return DefragPlan();
+
+	return PlanWindow(IndexType(required_chunks));
+}
+
+template <typename Policies>
+bool ListHeapEngine<Policies>::IteratePlan(DefragPlan &plan)
+{
+	AssertHeapInvariants();
+
+	// Find the first free block reaching into the window
+	auto free_block = FindNearestFreeBlock(plan._begin);
+	if (free_block + _heap[free_block]._block_metadata._num_chunks <= plan._begin)
+		free_block = _heap[free_block]._next_free;
+
+	// Is the plan complete, or has the heap changed so nothing is left to slide in the window
+	if (free_block == NULL_INDEX || free_block >= plan._end)
+		return true;
+
+	if (_heap[free_block]._block_metadata._num_chunks >= plan._free_chunks ||
+		free_block + _heap[free_block]._block_metadata._num_chunks >= plan._end)
+		return true;
+
+	const auto moved_block = SlideRun(free_block);
+
+	return _heap[moved_block]._block_metadata._num_chunks >= plan._free_chunks;
+}
+
+template <typename Policies>
+HeapChunk* ListHeapEngine<Policies>::CompactInto(HeapChunk* buffer, size_t num_threads)
+{
+	AssertHeapInvariants();
+	assert(buffer && buffer != _data && num_threads);
+
+	// A contiguous part of the heap copied by one thread, starting at a run of allocated blocks
+	struct CompactPart
+	{
+		IndexType _index;
+		IndexType _new_index;
+		IndexType _prev;
+	};
+
+	// Plan where each run of allocated blocks lands, the table lives in the new storage until the runs are copied over it
+	// Runs are separated by free blocks so there are never more of them than chunks
+	const IndexType first_block = NULL_INDEX + _heap[NULL_INDEX]._block_metadata._num_chunks;
+	const size_t live_chunks = _num_chunks - _free_chunks - first_block;
+	auto relocations = reinterpret_cast<PointerRelocation*>(buffer);
+	size_t num_relocations = 0;
+	std::vector<CompactPart> parts(1, CompactPart{ first_block, first_block, NULL_INDEX });
+	IndexType new_index = first_block;
+	IndexType prev = NULL_INDEX;
+	bool in_run = false;
+	for (IndexType index = first_block; index < _num_chunks; index += _heap[index]._block_metadata._num_chunks)
+	{
+		const auto &block = _heap[index];
+		if (!block._block_metadata._is_allocated)
+		{
+			// The free blocks are gathered into one at the end, drop them from the index now
+			if (FitPolicy::INDEXED)
+				_free_index.Remove(index);
+
+			in_run = false;
+			continue;
+		}
+
+		if (!in_run)
+		{
+			// Start the next part once the current one holds its share of the live chunks
+			if (parts.size() < num_threads && (new_index - first_block) * num_threads >= parts.size() * live_chunks)
+				parts.push_back(CompactPart{ index, new_index, prev });
+
+			relocations[num_relocations]._lower_bound = intptr_t(&_data[index]);
+			relocations[num_relocations]._offset = intptr_t(&buffer[new_index]) - intptr_t(&_data[index]);
+			num_relocations++;
+			in_run = true;
+		}
+
+		prev = new_index;
+		new_index += block._block_metadata._num_chunks;
+	}
+
+	assert(new_index + _free_chunks == _num_chunks);
+
+	// Update defraggable pointers before invalidating the heap, one pass for every run
+	_pointer_list.RelocatePointersInRange(&_data[first_block], &_data[_num_chunks], relocations, num_relocations);
+
+	/* CONSIDER THE HEAP INVALID FROM HERE */
+
+	// Copy the null sentinel node, then stream the parts into place
+	// The new storage never overlaps the old, so the parts are copied concurrently in any order
+	SIMDMemCopy(buffer, _data, first_block);
+
+	std::vector<std::thread> threads;
+	threads.reserve(parts.size() - 1);
+	for (size_t i = 1; i < parts.size(); ++i)
+	{
+		const auto end = i + 1 < parts.size() ? parts[i + 1]._index : _num_chunks;
+		threads.emplace_back(&ListHeapEngine::CopyRuns, this, buffer, parts[i]._index, end, parts[i]._new_index, parts[i]._prev);
+	}
+
+	CopyRuns(buffer, first_block, parts.size() > 1 ? parts[1]._index : _num_chunks, first_block, NULL_INDEX);
+
+	for (auto &thread : threads)
+		thread.join();
+
+	// Out of band headers stay in their array and are moved down in place, which never overwrites one not yet read
+	if (!_header_chunks)
+	{
+		IndexType header_prev = NULL_INDEX;
+		IndexType new_header = first_block;
+		for (IndexType index = first_block; index < _num_chunks;)
+		{
+			const auto num_chunks = _heap[index]._block_metadata._num_chunks;
+			if (_heap[index]._block_metadata._is_allocated)
+			{
+				_heap[new_header] = _heap[index];
+				_heap[new_header]._prev = header_prev;
+				header_prev = new_header;
+				new_header += num_chunks;
+			}
+
+			index += num_chunks;
+		}
+	}
+
+	// Adopt the new storage
+	const auto old_data = _data;
+	_data = buffer;
+	if (_header_chunks)
+		_heap = reinterpret_cast<ListHeader*>(buffer);
+
+	// Rebuild the free list around the single free block at the end of the heap
+	_heap[NULL_INDEX]._next_free = NULL_INDEX;
+	_heap[NULL_INDEX]._prev_free = NULL_INDEX;
+	_max_hole_chunks = 0;
+	_max_hole_count = 0;
+	_rover_index = NULL_INDEX;
+	if (_free_chunks)
+	{
+		new (&_heap[new_index]) ListHeader(prev, NULL_INDEX, NULL_INDEX, _free_chunks, FREE);
+
+		/* HEAP IS NOW VALID */
+
+		InsertFreeBlock(NULL_INDEX, new_index);
+		_rover_index = new_index;
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_index), MOVE_PATTERN, GetBlockDataChunks(new_index));
+	}
+
+	AssertHeapInvariants();
+
+	return old_data;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::CopyRuns(HeapChunk* buffer, IndexType index, IndexType end, IndexType new_index, IndexType prev)
+{
+	auto new_heap = reinterpret_cast<ListHeader*>(buffer);
+	while (index < end)
+	{
+		if (!_heap[index]._block_metadata._is_allocated)
+		{
+			index += _heap[index]._block_metadata._num_chunks;
+			continue;
+		}
+
+		// Find the end of the run of allocated blocks
+		auto run_end = index;
+		while (run_end < end && _heap[run_end]._block_metadata._is_allocated)
+			run_end += _heap[run_end]._block_metadata._num_chunks;
+
+		SIMDMemCopy(&buffer[new_index], &_data[index], run_end - index);
+
+		// Inline headers moved along with their data, patch them in a single pass
+		if (!_header_chunks)
+		{
+			new_index += run_end - index;
+			index = run_end;
+			continue;
+		}
+
+		while (index < run_end)
+		{
+			const auto num_chunks = new_heap[new_index]._block_metadata._num_chunks;
+			new_heap[new_index]._prev = prev;
+			prev = new_index;
+			index += num_chunks;
+			new_index += num_chunks;
+		}
+	}
+}
+
+template <typename Policies>
+DefragPlan ListHeapEngine<Policies>::PlanWindow(IndexType required_chunks) const
+{
+	assert(required_chunks && _free_chunks >= required_chunks);
+
+	// Slide a window of adjacent blocks over the heap, kept as short as possible while it holds
+	// enough free chunks, and remember the window with the fewest live chunks to move
+	const IndexType first_block = NULL_INDEX + _heap[NULL_INDEX]._block_metadata._num_chunks;
+	DefragPlan window(first_block, first_block);
+	DefragPlan plan(NULL_INDEX, NULL_INDEX);
+	plan._move_chunks = _num_chunks;
+	IndexType window_free_blocks = 0;
+	for (IndexType index = first_block; index < _num_chunks; index += _heap[index]._block_metadata._num_chunks)
+	{
+		const auto &block = _heap[index];
+		window._end = index + block._block_metadata._num_chunks;
+		if (block._block_metadata._is_allocated)
+		{
+			window._move_chunks += block._block_metadata._num_chunks;
+			window._move_blocks++;
+		}
+		else
+		{
+			window._free_chunks += block._block_metadata._num_chunks;
+			window_free_blocks++;
+		}
+
+		// Drop the blocks the window does not need off its front, so it always starts with a free block
+		while (window._begin != index)
+		{
+			const auto &front = _heap[window._begin];
+			if (front._block_metadata._is_allocated)
+			{
+				window._move_chunks -= front._block_metadata._num_chunks;
+				window._move_blocks--;
+			}
+			else if (window._free_chunks - front._block_metadata._num_chunks >= required_chunks)
+			{
+				window._free_chunks -= front._block_metadata._num_chunks;
+				window_free_blocks--;
+			}
+			else
+				break;
+
+			window._begin += front._block_metadata._num_chunks;
+		}
+
+		if (window._free_chunks >= required_chunks && window._move_chunks < plan._move_chunks)
+		{
+			// Free blocks and runs of allocated blocks alternate, each run between two free blocks slides once
+			plan = window;
+			plan._move_runs = window_free_blocks - 1;
+		}
+	}
+
+	assert(plan._begin != NULL_INDEX);
+
+	return plan;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::DefragForAllocation(IndexType required_chunks)
+{
+	// Carry out the cheapest plan that gathers enough free chunks in one go
+	auto plan = PlanWindow(required_chunks);
+	while (!IteratePlan(plan))
+		;
+}
+
+template <typename Policies>
+void ListHeapEngine<Policies>::FullDefragFromTop()
+{
 	AssertHeapInvariants();
 
+	while (!IterateHeapFromTop())
+		;
+
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+bool ListHeapEngine<Policies>::IterateHeapFromTop()
+{
+	AssertHeapInvariants();
+	// Do we actually need to defrag the heap
+	if (IsFullyDefragmented())
+		return true;
+
+	// The lowest hole in the heap heads the free list
+	const auto free_block = _heap[NULL_INDEX]._next_free;
+	const auto free_chunks = _heap[free_block]._block_metadata._num_chunks;
+
+	// Find the last block in the heap, the last free block is either it or close below it
+	IndexType top_block = _heap[NULL_INDEX]._prev_free;
+	while (top_block + _heap[top_block]._block_metadata._num_chunks < _num_chunks)
+		top_block += _heap[top_block]._block_metadata._num_chunks;
+
+	// Walk down from the top of the heap to the highest allocated block that fits the hole
+	// An exact fit further down is worth the extra steps as it leaves no sliver of a hole behind
+	IndexType move_block = NULL_INDEX;
+	IndexType search_blocks = TOP_FIT_SEARCH_BLOCKS;
+	for (IndexType index = top_block; index > free_block && search_blocks--; index = _heap[index]._prev)
+	{
+		const auto &block = _heap[index];
+		if (block._block_metadata._is_allocated && block._block_metadata._num_chunks <= free_chunks)
+		{
+			if (move_block == NULL_INDEX || block._block_metadata._num_chunks == free_chunks)
+				move_block = index;
+
+			if (block._block_metadata._num_chunks == free_chunks)
+				break;
+		}
+	}
+
+	// No block above fits the hole, slide the blocks after it down instead
+	if (move_block == NULL_INDEX)
+		return IterateHeap();
+
+	// Update defraggable pointers before invalidating the heap
+	const auto move_chunks = _heap[move_block]._block_metadata._num_chunks;
+	_pointer_list.OffsetPointersInRange(&_data[move_block], &_data[move_block + move_chunks], (ptrdiff_t(free_block) - ptrdiff_t(move_block)) * 16);
+
+	// Allocate the hole to the block and move the data, the two never overlap
+	AllocateBlock(free_block, move_chunks);
+	SIMDMemCopy(GetBlockData(free_block), GetBlockData(move_block), GetBlockDataChunks(free_block));
+
+	// The block is near the top so its previous free block is quicker to find from the end of the free list
+	IndexType prev_free = _heap[NULL_INDEX]._prev_free;
+	while (prev_free > move_block)
+		prev_free = _heap[prev_free]._prev_free;
+
+	// Release the old block, merging it with its free neighbours
+	FreeBlock(move_block, prev_free);
+
 	return IsFullyDefragmented();
 }
 
-void ListHeap::AssertHeapInvariants() const
+template <typename Policies>
+void ListHeapEngine<Policies>::AssertHeapInvariants() const
 {
 #ifdef NDEBUG
 	// We don't want to call this in release code
 	return;
 #endif
 
+	// The debug policy may opt out of invariant checking
+	if (!DebugPolicy::CHECK_INVARIANTS)
+		return;
+
 	/**
 	*	List heap uses a null sentinel node to simplify some heap operations.
 	*/
@@ -558,6 +1343,31 @@ void ListHeap::AssertHeapInvariants() const
 		assert(size == _free_chunks);
 	}
 
+	/**
+	*	List heap tracks an upper bound on the size of the free blocks other than the wilderness.
+	*	The bound is exact while it counts any holes of its size, and there are at least that many.
+	*/
+	{
+		IndexType max_hole_count = 0;
+		IndexType index = 1;
+		while (index < _num_chunks)
+		{
+			const auto next = index + _heap[index]._block_metadata._num_chunks;
+
+			// Assert bound invariant on holes
+			if (!_heap[index]._block_metadata._is_allocated && next < _num_chunks)
+			{
+				assert(_heap[index]._block_metadata._num_chunks <= _max_hole_chunks);
+				if (_heap[index]._block_metadata._num_chunks == _max_hole_chunks)
+					++max_hole_count;
+			}
+
+			index = next;
+		}
+
+		assert(max_hole_count >= _max_hole_count);
+	}
+
 	/**
 	*	List heap uses a free list to track the free blocks in the heap. Apart from the null node, only free blocks are in the list
 	*/
@@ -603,6 +1413,18 @@ void ListHeap::AssertHeapInvariants() const
 		assert(out.empty());
 	}
 
+	/**
+	*	List heap keeps the rover on a block in the free list, or the null node.
+	*/
+	if (FitPolicy::ROVING)
+	{
+		IndexType node = _heap[NULL_INDEX]._next_free;
+		while (node != NULL_INDEX && node != _rover_index)
+			node = _heap[node]._next_free;
+
+		assert(node == _rover_index);
+	}
+
 	/**
 	*	List heap free list cycles should be symmetric
 	*/
@@ -632,6 +1454,25 @@ void ListHeap::AssertHeapInvariants() const
 			assert(*fit == *bit);
 	}
 
+	/**
+	*	List heap indexed policies keep every free block in the free block index with its current size.
+	*/
+	if (FitPolicy::INDEXED)
+	{
+		IndexType count = 0;
+		IndexType node = _heap[NULL_INDEX]._next_free;
+		while (node != NULL_INDEX)
+		{
+			assert(_free_index.GetNumChunks(node) == _heap[node]._block_metadata._num_chunks);
+			++count;
+
+			node = _heap[node]._next_free;
+		}
+
+		assert(_free_index.GetCount() == count);
+		_free_index.AssertInvariants();
+	}
+
 	/**
 	*	List heap free list next cycle should be in increasing order
 	*/
@@ -659,4 +1500,7 @@ void ListHeap::AssertHeapInvariants() const
 			prev = _heap[prev]._prev_free;
 		}
 	}
-}
\ No newline at end of file
+}
+
+// Instantiate the engine for the supported policy combinations
+INSTANTIATE_HEAP_ENGINE(ListHeapEngine)
\ No newline at end of file
@@ -24,32 +24,47 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#pragma once
+
+#include "BasicDefraggableHeap.h"
 #include "DefraggablePointerList.h"
+#include "FreeBlockIndex.h"
+#include "PackedFreeBlockIndex.h"
 #include "HeapCommon.h"
+#include "HeapPolicies.h"
 
 #include <tuple>
+#include <type_traits>
 
 struct ListHeader;
 
 /**
-*	A defraggable heap implemented as a doubly linked list.
+*	A defraggable heap engine implemented as a doubly linked list.
+*
+*	@tparam Policies the HeapPolicies bundle the engine is compiled for
 */
-class ListHeap final
+template <typename Policies>
+class ListHeapEngine
 {
 
 public:
 
+	typedef typename Policies::FitPolicy FitPolicy;
+	typedef typename Policies::PointerPolicy PointerPolicy;
+	typedef typename Policies::DebugPolicy DebugPolicy;
+
 	/**
 	*	Constructs a list heap.
 	*
 	*	@param size the size of the heap in bytes.
+	*	@param layout where the block headers should be stored
 	*/
-	ListHeap(size_t size);
+	ListHeapEngine(size_t size, HeaderLayout layout = INLINE_HEADERS);
 
 	/**
 	*	Destroys a list heap.
 	*/
-	~ListHeap();
+	~ListHeapEngine();
 
 	/**
 	*	Allocates from the list heap. Always 16 byte aligned.
@@ -59,9 +74,20 @@ public:
 	*/
 	DefraggablePointerControlBlock Allocate(size_t num_bytes);
 
+	/**
+	*	Allocates from the list heap, placing the block by how long it is expected to live. Always 16 byte aligned.
+	*	Long lived blocks are placed by the fit policy, short lived ones off the top of the highest free block that fits.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@param hint how long the block is expected to live
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes, LifetimeHint hint);
+
 	/**
 	*	Frees the given heap data. Invalidates all defraggable pointers
-	*	pointing into the free block.
+	*	pointing into the free block, or only the given pointer if the 
+	*	pointer policy does not track aliases.
 	*
 	*	@param ptr pointer into block in heap to free
 	*/
@@ -80,6 +106,59 @@ public:
 	*/
 	bool IterateHeap();
 
+	/**
+	*	Fully defragments the heap by filling holes from the top of the heap.
+	*/
+	void FullDefragFromTop();
+
+	/**
+	*	Iterates the two finger defragmentation process on the heap.
+	*	Fills the lowest hole with a block from the top of the heap that fits it, so the
+	*	bytes moved scale with the fragmentation rather than the live data above the hole.
+	*	Slides the blocks after the hole down when none of them fit.
+	*	Heap is still valid for use after a call to this method.
+	*
+	*	@returns true if the heap is now fully defragmented
+	*/
+	bool IterateHeapFromTop();
+
+	/**
+	*	Sets if an allocation that finds no free block large enough should compact the cheapest
+	*	window of blocks holding enough free space and retry, instead of failing.
+	*
+	*	@param enable true to make room for failed allocations
+	*/
+	void SetDefragOnAllocateFailure(bool enable);
+
+	/**
+	*	Plans the cheapest compaction that makes room for an allocation of the given size, without moving anything.
+	*	The plan compacts the whole heap if the size is 0 or more than the heap has free.
+	*
+	*	@param num_bytes the size of the allocation to make room for
+	*	@returns the plan and its cost
+	*/
+	DefragPlan PlanDefrag(size_t num_bytes = 0) const;
+
+	/**
+	*	Iterates the given plan, sliding one run of allocated blocks in its window down.
+	*	Heap is still valid for use after a call to this method.
+	*
+	*	@param plan the plan made by this heap
+	*	@returns true if the plan is complete
+	*/
+	bool IteratePlan(DefragPlan &plan);
+
+	/**
+	*	Fully defragments the heap by copying the allocated blocks in address order into the given storage,
+	*	which the heap then adopts. Each byte of live data is copied once, unlike sliding it down in place.
+	*	The copy is split into parts holding an even share of the live data, each copied on its own thread.
+	*
+	*	@param buffer storage for at least the size of the heap, allocated with AlignedNew 16 byte aligned
+	*	@param num_threads the number of threads copying the heap, including the calling thread
+	*	@returns the storage the heap used before, for the next compaction or AlignedDelete
+	*/
+	HeapChunk* CompactInto(HeapChunk* buffer, size_t num_threads = 1);
+
 	/**
 	*	Gets the fragmentation ratio of the heap.
 	*
@@ -97,12 +176,131 @@ public:
 protected:
 
 	/**
-	*	Finds a free heap block of desired size.
+	*	Allocates a block of the given number of chunks, including the header.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunks(IndexType required_chunks);
+
+	/**
+	*	Allocates a block of the given number of chunks, including the header, off the top of the highest free block that fits.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunksFromTop(IndexType required_chunks);
+
+	/**
+	*	Slides the run of allocated blocks after the given free block down over it,
+	*	merging the moved free block with the next free block.
+	*
+	*	@param free_block the index of the free block
+	*	@returns the index of the moved free block
+	*/
+	IndexType SlideRun(IndexType free_block);
+
+	/**
+	*	Finds the window of adjacent blocks holding enough free chunks that moves the fewest live chunks.
+	*
+	*	@param required_chunks the number of free chunks the window needs
+	*	@returns the plan compacting the window
+	*/
+	DefragPlan PlanWindow(IndexType required_chunks) const;
+
+	/**
+	*	Makes room for an allocation by carrying out the cheapest plan for it.
+	*
+	*	@param required_chunks the number of chunks the allocation needs
+	*/
+	void DefragForAllocation(IndexType required_chunks);
+
+	/**
+	*	Copies the runs of allocated blocks in the given part of the heap back to back into new storage.
+	*	Inline headers are patched in the new storage, out of band headers are left for the caller to move.
+	*
+	*	@param buffer the new storage
+	*	@param index the index of the first block in the part
+	*	@param end the index after the last block in the part
+	*	@param new_index the index the first allocated block lands at
+	*	@param prev the new index of the allocated block before the part
+	*/
+	void CopyRuns(HeapChunk* buffer, IndexType index, IndexType end, IndexType new_index, IndexType prev);
+
+	/**
+	*	Allocates the front of the given free block, splitting off any remaining chunks.
+	*
+	*	@param found_block the index of the free block
+	*	@param required_chunks the number of chunks the block needs
+	*/
+	void AllocateBlock(IndexType found_block, IndexType required_chunks);
+
+	/**
+	*	Allocates the back of the given free block, shrinking it in place to any remaining chunks.
+	*
+	*	@param found_block the index of the free block
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the index of the allocated block
+	*/
+	IndexType AllocateBlockFromTop(IndexType found_block, IndexType required_chunks);
+
+	/**
+	*	Frees the given allocated block, merging it with its free neighbours.
+	*	Defraggable pointers into the block must already be invalidated or moved.
+	*
+	*	@param new_offset the index of the allocated block
+	*	@param prev_free the index of the nearest free block before it
+	*/
+	void FreeBlock(IndexType new_offset, IndexType prev_free);
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size.
 	*
 	*	@param num_chunks the minimum number of chunks required in the free block
 	*	@returns the free block index
 	*/
-	IndexType FindFreeBlock(IndexType num_chunks) const;
+	IndexType FindFreeBlock(IndexType num_chunks, FirstFitPolicy) const;
+
+	/**
+	*	Finds the first free heap block of desired size from the rover, wrapping around
+	*	to the start of the heap.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index
+	*/
+	IndexType FindFreeBlock(IndexType num_chunks, NextFitPolicy) const;
+
+	/**
+	*	Finds the smallest free heap block of desired size, breaking ties on the lowest address.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index
+	*/
+	IndexType FindFreeBlock(IndexType num_chunks, BestFitPolicy) const;
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size in the free block index.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index
+	*/
+	IndexType FindFreeBlock(IndexType num_chunks, IndexedFirstFitPolicy) const;
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size in the packed free block index.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index
+	*/
+	IndexType FindFreeBlock(IndexType num_chunks, PackedFirstFitPolicy) const;
+
+	/**
+	*	Finds the highest addressed free heap block of desired size, walking the free list from its end.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block index
+	*/
+	IndexType FindLastFreeBlock(IndexType num_chunks) const;
 
 	/**
 	*	Removes the free block from the free list. 
@@ -121,31 +319,118 @@ protected:
 	*/
 	void InsertFreeBlock(IndexType root, IndexType index);
 	
+	/**
+	*	Grows the given free block, keeping the free block index up to date.
+	*
+	*	@param index the index of the free block
+	*	@param num_chunks the number of chunks to grow the block by
+	*/
+	void GrowFreeBlock(IndexType index, IndexType num_chunks);
+
+	/**
+	*	Adds the given free block to the statistics of the largest hole, unless it is the wilderness.
+	*
+	*	@param index the index of the free block
+	*/
+	void AddHole(IndexType index);
+
+	/**
+	*	Removes the given free block from the statistics of the largest hole, unless it is the wilderness.
+	*	Must be called before the block size is changed.
+	*
+	*	@param index the index of the free block
+	*/
+	void RemoveHole(IndexType index);
+
+	/**
+	*	Lowers the upper bound on the size of the holes after a search found none of the given size.
+	*
+	*	@param num_chunks the largest number of chunks a hole can have
+	*/
+	void LowerMaxHoleChunks(IndexType num_chunks);
+
+	/**
+	*	Gets the number of chunks in the largest hole, walking the free list only if
+	*	the largest holes were allocated or merged away since the last call.
+	*
+	*	@returns the size of the largest free block before the wilderness
+	*/
+	IndexType GetMaxHoleChunks() const;
+
 	/**
 	*	Finds the the nearest free block with a smaller offset in the freelist.
+	*	Indexed policies look it up in the free block index instead of walking the list.
 	*
 	*	@param index the reference block index to find
 	*	@returns the nearest free block 
 	*/
 	IndexType FindNearestFreeBlock(IndexType index) const;
 
+	/**
+	*	Gets the payload address of the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the address of the first payload chunk
+	*/
+	HeapChunk* GetBlockData(IndexType index) const;
+
+	/**
+	*	Gets the number of payload chunks in the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the number of chunks not used by the block header
+	*/
+	IndexType GetBlockDataChunks(IndexType index) const;
+
 	/**
 	*	Asserts invariants over the heap.
 	*/
 	void AssertHeapInvariants() const;
 
-	/**< The data heap we manage. */
+	/**< The block headers we manage, indexed by chunk. */
 	ListHeader* _heap;
 
+	/**< The payload chunks we manage. Aliases the headers when they are stored inline. */
+	HeapChunk* _data;
+
+	/**< The number of chunks each block spends on its header. */
+	IndexType _header_chunks;
+
 	/**< The number of chunks in the heap. */
 	IndexType _num_chunks;
 
 	/**< The total number of free chunks in the heap. */
 	IndexType _free_chunks;
 
+	/**< An upper bound on the size of the free blocks before the wilderness at the end of the heap, exact while the count is not zero. */
+	mutable IndexType _max_hole_chunks;
+
+	/**< A lower bound on the number of holes the size of the bound. Both are refreshed by fragmentation queries. */
+	mutable IndexType _max_hole_count;
+
+	/**< The free block after the last allocation, where roving fit policies start searching. */
+	IndexType _rover_index;
+
+	/**< Should a failed allocation compact a window of the heap and retry. */
+	bool _defrag_on_allocate_failure;
+
+	/**< The type of free block index the fit policy searches. */
+	typedef typename std::conditional<FitPolicy::PACKED, PackedFreeBlockIndex, FreeBlockIndex>::type FreeIndex;
+
+	/**< The address ordered index of free blocks, only maintained by indexed policies. */
+	FreeIndex _free_index;
+
 	/**< The list of defraggable pointers for this heap. */
 	DefraggablePointerList _pointer_list;
 
 	/**< The offset of the null sentinel node into the heap. */
 	static const IndexType NULL_INDEX = 0;
-};
\ No newline at end of file
+
+	/**< The number of blocks below the top of the heap searched for one that fits the hole being filled. */
+	static const IndexType TOP_FIT_SEARCH_BLOCKS = 64;
+};
+
+/**
+*	A defraggable heap implemented as a doubly linked list with the default policies.
+*/
+typedef BasicDefraggableHeap<ListHeapEngine> ListHeap;
\ No newline at end of file
@@ -0,0 +1,206 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "stdafx.h"
+
+#include "PackedFreeBlockIndex.h"
+#include "AlignedAllocator.h"
+
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+
+#include <intrin.h>
+#include <emmintrin.h>
+#include <smmintrin.h>
+
+PackedFreeBlockIndex::PackedFreeBlockIndex()
+	: _keys(static_cast<IndexType*>(AlignedNew(INITIAL_CAPACITY * sizeof(IndexType), 64)))
+	, _num_chunks(static_cast<IndexType*>(AlignedNew(INITIAL_CAPACITY * sizeof(IndexType), 64)))
+	, _capacity(INITIAL_CAPACITY)
+	, _count(0)
+{
+	// The padding must never fit an allocation
+	memset(_num_chunks, 0, _capacity * sizeof(IndexType));
+}
+
+PackedFreeBlockIndex::~PackedFreeBlockIndex()
+{
+	AlignedDelete(_num_chunks);
+	AlignedDelete(_keys);
+}
+
+void PackedFreeBlockIndex::Insert(IndexType index, IndexType num_chunks)
+{
+	assert(num_chunks);
+
+	const auto position = LowerBound(index);
+	assert(position == _count || _keys[position] != index);
+
+	// Double the arrays when they are full, the capacity stays a multiple of the search width
+	if (_count == _capacity)
+	{
+		auto *const keys = static_cast<IndexType*>(AlignedNew(2 * _capacity * sizeof(IndexType), 64));
+		auto *const sizes = static_cast<IndexType*>(AlignedNew(2 * _capacity * sizeof(IndexType), 64));
+		memcpy(keys, _keys, _count * sizeof(IndexType));
+		memcpy(sizes, _num_chunks, _count * sizeof(IndexType));
+		memset(sizes + _count, 0, (2 * _capacity - _count) * sizeof(IndexType));
+
+		AlignedDelete(_num_chunks);
+		AlignedDelete(_keys);
+
+		_keys = keys;
+		_num_chunks = sizes;
+		_capacity *= 2;
+	}
+
+	// Shift the tail up to make room
+	const auto tail = (_count - position) * sizeof(IndexType);
+	memmove(_keys + position + 1, _keys + position, tail);
+	memmove(_num_chunks + position + 1, _num_chunks + position, tail);
+
+	_keys[position] = index;
+	_num_chunks[position] = num_chunks;
+	++_count;
+}
+
+void PackedFreeBlockIndex::Remove(IndexType index)
+{
+	const auto position = LowerBound(index);
+	assert(position < _count && _keys[position] == index);
+
+	// Shift the tail down over the entry
+	const auto tail = (_count - position - 1) * sizeof(IndexType);
+	memmove(_keys + position, _keys + position + 1, tail);
+	memmove(_num_chunks + position, _num_chunks + position + 1, tail);
+
+	// The vacated entry becomes padding
+	--_count;
+	_num_chunks[_count] = 0;
+}
+
+void PackedFreeBlockIndex::Resize(IndexType index, IndexType num_chunks)
+{
+	assert(num_chunks);
+
+	const auto position = LowerBound(index);
+	assert(position < _count && _keys[position] == index);
+
+	_num_chunks[position] = num_chunks;
+}
+
+IndexType PackedFreeBlockIndex::FindFirstFit(IndexType num_chunks) const
+{
+	assert(num_chunks);
+
+	// Sizes fit in 31 bits, so a signed compare against one less than the request finds the fits
+	const __m128i threshold = _mm_set1_epi32(int(num_chunks - 1));
+	auto sizes = reinterpret_cast<const __m128i*>(_num_chunks);
+
+	// The padding past the count never fits, so whole iterations can be scanned
+	for (IndexType i = 0; i < _count; i += LANES, sizes += 4)
+	{
+		const __m128i fit0 = _mm_cmpgt_epi32(_mm_load_si128(sizes + 0), threshold);
+		const __m128i fit1 = _mm_cmpgt_epi32(_mm_load_si128(sizes + 1), threshold);
+		const __m128i fit2 = _mm_cmpgt_epi32(_mm_load_si128(sizes + 2), threshold);
+		const __m128i fit3 = _mm_cmpgt_epi32(_mm_load_si128(sizes + 3), threshold);
+
+		// Narrow the compare results to a byte per entry, keeping them in address order
+		const __m128i fits = _mm_packs_epi16(_mm_packs_epi32(fit0, fit1), _mm_packs_epi32(fit2, fit3));
+		const unsigned long mask = _mm_movemask_epi8(fits);
+
+		// The lowest set bit is the lowest addressed fit
+		unsigned long lane;
+		if (_BitScanForward(&lane, mask))
+			return _keys[i + lane];
+	}
+
+	return 0;
+}
+
+IndexType PackedFreeBlockIndex::FindPrevious(IndexType index) const
+{
+	const auto position = LowerBound(index);
+
+	return position ? _keys[position - 1] : 0;
+}
+
+IndexType PackedFreeBlockIndex::GetNumChunks(IndexType index) const
+{
+	const auto position = LowerBound(index);
+
+	return position < _count && _keys[position] == index ? _num_chunks[position] : 0;
+}
+
+IndexType PackedFreeBlockIndex::GetMaxNumChunks() const
+{
+	__m128i max = _mm_setzero_si128();
+	auto sizes = reinterpret_cast<const __m128i*>(_num_chunks);
+
+	for (IndexType i = 0; i < _count; i += 4, sizes++)
+		max = _mm_max_epi32(max, _mm_load_si128(sizes));
+
+	// Fold the lanes together
+	max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(1, 0, 3, 2)));
+	max = _mm_max_epi32(max, _mm_shuffle_epi32(max, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	return IndexType(_mm_cvtsi128_si32(max));
+}
+
+IndexType PackedFreeBlockIndex::GetCount() const
+{
+	return _count;
+}
+
+IndexType PackedFreeBlockIndex::LowerBound(IndexType index) const
+{
+	return IndexType(std::lower_bound(_keys, _keys + _count, index) - _keys);
+}
+
+void PackedFreeBlockIndex::AssertInvariants() const
+{
+#ifdef NDEBUG
+	return;
+#endif
+
+	// Searches read whole iterations of the arrays
+	assert(_capacity % LANES == 0);
+	assert(_count <= _capacity);
+
+	// Entries are in address order and hold a real size, the padding after them is zero
+	for (IndexType i = 0; i < _capacity; ++i)
+	{
+		if (i < _count)
+		{
+			assert(i == 0 || _keys[i - 1] < _keys[i]);
+			assert(_num_chunks[i] > 0);
+		}
+		else
+		{
+			assert(_num_chunks[i] == 0);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2015, Missing Box Studio
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+* Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+* Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "HeapCommon.h"
+
+/**
+*	An index of the free blocks of a heap kept as two address ordered arrays, one of block indices and one of block sizes.
+*
+*	A first fit search compares 16 packed sizes per loop iteration with SIMD instead of loading a header per free block,
+*	and the compares of one iteration do not depend on each other. Insertions and removals shift the tail of the arrays,
+*	a sequential copy that stays cheap for the free list lengths a heap sees in practice.
+*/
+class PackedFreeBlockIndex
+{
+public:
+	/**
+	*	Constructs an empty packed free block index.
+	*/
+	PackedFreeBlockIndex();
+
+	/**
+	*	Destroys a packed free block index.
+	*/
+	~PackedFreeBlockIndex();
+
+	/**
+	*	Copying is undefined.
+	*/
+	PackedFreeBlockIndex(const PackedFreeBlockIndex &) = delete;
+
+	/**
+	*	Copying is undefined.
+	*/
+	PackedFreeBlockIndex& operator=(const PackedFreeBlockIndex &) = delete;
+
+	/**
+	*	Inserts a free block into the index.
+	*
+	*	@param index the index of the free block, must not be in the index
+	*	@param num_chunks the number of chunks in the free block
+	*/
+	void Insert(IndexType index, IndexType num_chunks);
+
+	/**
+	*	Removes a free block from the index.
+	*
+	*	@param index the index of the free block, must be in the index
+	*/
+	void Remove(IndexType index);
+
+	/**
+	*	Changes the size of a free block in the index.
+	*
+	*	@param index the index of the free block, must be in the index
+	*	@param num_chunks the new number of chunks in the free block
+	*/
+	void Resize(IndexType index, IndexType num_chunks);
+
+	/**
+	*	Finds the lowest addressed free block of desired size.
+	*
+	*	@param num_chunks the minimum number of chunks required in the free block, must not be 0
+	*	@returns the free block index, 0 if no free block is large enough
+	*/
+	IndexType FindFirstFit(IndexType num_chunks) const;
+
+	/**
+	*	Finds the highest addressed free block below the given index.
+	*
+	*	@param index the reference block index
+	*	@returns the free block index, 0 if there is no free block below the reference
+	*/
+	IndexType FindPrevious(IndexType index) const;
+
+	/**
+	*	Gets the number of chunks in an indexed free block.
+	*
+	*	@param index the index of the free block
+	*	@returns the number of chunks in the free block, 0 if the block is not in the index
+	*/
+	IndexType GetNumChunks(IndexType index) const;
+
+	/**
+	*	Gets the largest free block in the index.
+	*
+	*	@returns the number of chunks in the largest free block
+	*/
+	IndexType GetMaxNumChunks() const;
+
+	/**
+	*	Gets the number of free blocks in the index.
+	*
+	*	@returns the number of free blocks
+	*/
+	IndexType GetCount() const;
+
+	/**
+	*	Asserts the ordering and padding of the arrays.
+	*/
+	void AssertInvariants() const;
+
+protected:
+
+	/**< The number of entries a single search iteration compares, the arrays are padded to a multiple of it. */
+	static const IndexType LANES = 16;
+
+	/**< The initial number of entries in the arrays. */
+	static const IndexType INITIAL_CAPACITY = 256;
+
+	/**
+	*	Finds the position of the first entry with an index not below the given index.
+	*
+	*	@param index the block index to find
+	*	@returns the position of the entry, the count if every entry is below the index
+	*/
+	IndexType LowerBound(IndexType index) const;
+
+	/**< The free block indices in increasing order. */
+	IndexType *_keys;
+
+	/**< The size of each free block in the key array, padded with zeros that never fit an allocation. */
+	IndexType *_num_chunks;
+
+	/**< The number of entries the arrays have room for. */
+	IndexType _capacity;
+
+	/**< The number of free blocks in the index. */
+	IndexType _count;
+};
\ No newline at end of file
@@ -29,8 +29,328 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "SIMDMem.h"
 
 #include <cassert>
+#include <cstdint>
+#include <intrin.h>
 #include <emmintrin.h>
 #include <smmintrin.h>
+#include <immintrin.h>
+
+/**
+*	The loops are unrolled four registers deep. Every iteration loads all of its registers before 
+*	storing any, so a target below an overlapping source never overwrites data it has yet to read.
+*	The wider loops use unaligned loads and stores as chunks are only 16 byte aligned,
+*	and hand the tail that does not fill an iteration to the SSE2 loop.
+*
+*	The streaming loops write with non-temporal stores, which bypass the caches. The source is left to the
+*	hardware prefetcher, software prefetching it measured slower. Streaming stores have to be aligned to the 
+*	register width, so the wider loops copy a few chunks with regular stores first. Callers fence once after the whole copy.
+*
+*	Large blocks are copied rather than moved by remapping their pages. Heaps allocate their storage with operator new,
+*	not as a view of a section they could remap, and compaction slides a block down by the size of the hole in front of it.
+*	That is rarely a whole number of pages, so remapped pages would still need their contents shifted.
+*/
+
+/**< The number of chunks above which copies stream, 8MB by default. Smaller targets are usually still cached. */
+static size_t STREAMING_THRESHOLD = 512 * 1024;
+
+static void SSE2MemCopy(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	for (; num_chunks >= 4; num_chunks -= 4, t += 4, s += 4)
+	{
+		// Load chunks from source address
+		const __m128i c0 = _mm_load_si128(s + 0);
+		const __m128i c1 = _mm_load_si128(s + 1);
+		const __m128i c2 = _mm_load_si128(s + 2);
+		const __m128i c3 = _mm_load_si128(s + 3);
+
+		// Store chunks into target address
+		_mm_store_si128(t + 0, c0);
+		_mm_store_si128(t + 1, c1);
+		_mm_store_si128(t + 2, c2);
+		_mm_store_si128(t + 3, c3);
+	}
+
+	for (; num_chunks; num_chunks--, t++, s++)
+		_mm_store_si128(t, _mm_load_si128(s));
+}
+
+static void SSE2MemStream(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	for (; num_chunks >= 4; num_chunks -= 4, t += 4, s += 4)
+	{
+		const __m128i c0 = _mm_load_si128(s + 0);
+		const __m128i c1 = _mm_load_si128(s + 1);
+		const __m128i c2 = _mm_load_si128(s + 2);
+		const __m128i c3 = _mm_load_si128(s + 3);
+
+		_mm_stream_si128(t + 0, c0);
+		_mm_stream_si128(t + 1, c1);
+		_mm_stream_si128(t + 2, c2);
+		_mm_stream_si128(t + 3, c3);
+	}
+
+	SSE2MemCopy(t, s, num_chunks);
+}
+
+static void SSE2MemSet(__m128i* t, __m128i chunk, size_t num_chunks)
+{
+	for (; num_chunks >= 4; num_chunks -= 4, t += 4)
+	{
+		_mm_store_si128(t + 0, chunk);
+		_mm_store_si128(t + 1, chunk);
+		_mm_store_si128(t + 2, chunk);
+		_mm_store_si128(t + 3, chunk);
+	}
+
+	for (; num_chunks; num_chunks--, t++)
+		_mm_store_si128(t, chunk);
+}
+
+static void AVX2MemCopy(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	// Two chunks per register
+	auto t256 = reinterpret_cast<__m256i*>(t);
+	auto s256 = reinterpret_cast<const __m256i*>(s);
+
+	for (; num_chunks >= 8; num_chunks -= 8, t256 += 4, s256 += 4)
+	{
+		const __m256i c0 = _mm256_loadu_si256(s256 + 0);
+		const __m256i c1 = _mm256_loadu_si256(s256 + 1);
+		const __m256i c2 = _mm256_loadu_si256(s256 + 2);
+		const __m256i c3 = _mm256_loadu_si256(s256 + 3);
+
+		_mm256_storeu_si256(t256 + 0, c0);
+		_mm256_storeu_si256(t256 + 1, c1);
+		_mm256_storeu_si256(t256 + 2, c2);
+		_mm256_storeu_si256(t256 + 3, c3);
+	}
+
+	// Avoid the transition penalty when returning to SSE code
+	_mm256_zeroupper();
+
+	SSE2MemCopy(reinterpret_cast<__m128i*>(t256), reinterpret_cast<const __m128i*>(s256), num_chunks);
+}
+
+static void AVX2MemStream(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	// Align the target to the register width
+	if ((reinterpret_cast<uintptr_t>(t) & 31) && num_chunks)
+	{
+		_mm_store_si128(t++, _mm_load_si128(s++));
+		num_chunks--;
+	}
+
+	auto t256 = reinterpret_cast<__m256i*>(t);
+	auto s256 = reinterpret_cast<const __m256i*>(s);
+
+	for (; num_chunks >= 8; num_chunks -= 8, t256 += 4, s256 += 4)
+	{
+		const __m256i c0 = _mm256_loadu_si256(s256 + 0);
+		const __m256i c1 = _mm256_loadu_si256(s256 + 1);
+		const __m256i c2 = _mm256_loadu_si256(s256 + 2);
+		const __m256i c3 = _mm256_loadu_si256(s256 + 3);
+
+		_mm256_stream_si256(t256 + 0, c0);
+		_mm256_stream_si256(t256 + 1, c1);
+		_mm256_stream_si256(t256 + 2, c2);
+		_mm256_stream_si256(t256 + 3, c3);
+	}
+
+	_mm256_zeroupper();
+
+	SSE2MemStream(reinterpret_cast<__m128i*>(t256), reinterpret_cast<const __m128i*>(s256), num_chunks);
+}
+
+static void AVX2MemSet(__m128i* t, __m128i chunk, size_t num_chunks)
+{
+	auto t256 = reinterpret_cast<__m256i*>(t);
+	const __m256i chunk256 = _mm256_broadcastsi128_si256(chunk);
+
+	for (; num_chunks >= 8; num_chunks -= 8, t256 += 4)
+	{
+		_mm256_storeu_si256(t256 + 0, chunk256);
+		_mm256_storeu_si256(t256 + 1, chunk256);
+		_mm256_storeu_si256(t256 + 2, chunk256);
+		_mm256_storeu_si256(t256 + 3, chunk256);
+	}
+
+	_mm256_zeroupper();
+
+	SSE2MemSet(reinterpret_cast<__m128i*>(t256), chunk, num_chunks);
+}
+
+static void AVX512MemCopy(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	// Four chunks per register
+	auto t512 = reinterpret_cast<__m512i*>(t);
+	auto s512 = reinterpret_cast<const __m512i*>(s);
+
+	for (; num_chunks >= 16; num_chunks -= 16, t512 += 4, s512 += 4)
+	{
+		const __m512i c0 = _mm512_loadu_si512(s512 + 0);
+		const __m512i c1 = _mm512_loadu_si512(s512 + 1);
+		const __m512i c2 = _mm512_loadu_si512(s512 + 2);
+		const __m512i c3 = _mm512_loadu_si512(s512 + 3);
+
+		_mm512_storeu_si512(t512 + 0, c0);
+		_mm512_storeu_si512(t512 + 1, c1);
+		_mm512_storeu_si512(t512 + 2, c2);
+		_mm512_storeu_si512(t512 + 3, c3);
+	}
+
+	_mm256_zeroupper();
+
+	SSE2MemCopy(reinterpret_cast<__m128i*>(t512), reinterpret_cast<const __m128i*>(s512), num_chunks);
+}
+
+static void AVX512MemStream(__m128i* t, const __m128i* s, size_t num_chunks)
+{
+	// Align the target to the register width
+	while ((reinterpret_cast<uintptr_t>(t) & 63) && num_chunks)
+	{
+		_mm_store_si128(t++, _mm_load_si128(s++));
+		num_chunks--;
+	}
+
+	auto t512 = reinterpret_cast<__m512i*>(t);
+	auto s512 = reinterpret_cast<const __m512i*>(s);
+
+	for (; num_chunks >= 16; num_chunks -= 16, t512 += 4, s512 += 4)
+	{
+		const __m512i c0 = _mm512_loadu_si512(s512 + 0);
+		const __m512i c1 = _mm512_loadu_si512(s512 + 1);
+		const __m512i c2 = _mm512_loadu_si512(s512 + 2);
+		const __m512i c3 = _mm512_loadu_si512(s512 + 3);
+
+		_mm512_stream_si512(t512 + 0, c0);
+		_mm512_stream_si512(t512 + 1, c1);
+		_mm512_stream_si512(t512 + 2, c2);
+		_mm512_stream_si512(t512 + 3, c3);
+	}
+
+	_mm256_zeroupper();
+
+	SSE2MemStream(reinterpret_cast<__m128i*>(t512), reinterpret_cast<const __m128i*>(s512), num_chunks);
+}
+
+static void AVX512MemSet(__m128i* t, __m128i chunk, size_t num_chunks)
+{
+	auto t512 = reinterpret_cast<__m512i*>(t);
+	const __m512i chunk512 = _mm512_broadcast_i32x4(chunk);
+
+	for (; num_chunks >= 16; num_chunks -= 16, t512 += 4)
+	{
+		_mm512_storeu_si512(t512 + 0, chunk512);
+		_mm512_storeu_si512(t512 + 1, chunk512);
+		_mm512_storeu_si512(t512 + 2, chunk512);
+		_mm512_storeu_si512(t512 + 3, chunk512);
+	}
+
+	_mm256_zeroupper();
+
+	SSE2MemSet(reinterpret_cast<__m128i*>(t512), chunk, num_chunks);
+}
+
+/**
+*	The loops the SIMD memory routines dispatch to.
+*/
+struct SIMDMemKernels
+{
+	/**< The active instruction set. */
+	SIMDLevel _level;
+
+	/**< The copy loop for the active instruction set. */
+	void (*_copy)(__m128i*, const __m128i*, size_t);
+
+	/**< The streaming copy loop for the active instruction set. */
+	void (*_stream)(__m128i*, const __m128i*, size_t);
+
+	/**< The set loop for the active instruction set. */
+	void (*_set)(__m128i*, __m128i, size_t);
+};
+
+static SIMDLevel DetectSIMDLevel()
+{
+	int info[4];
+
+	// Leaf 1 reports AVX and whether the operating system enabled XSAVE
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+
+	if (!osxsave || !avx)
+		return SIMD_SSE2;
+
+	// The operating system has to save the YMM registers, and the opmask and ZMM registers for AVX-512
+	const auto xcr0 = _xgetbv(0);
+	if ((xcr0 & 0x6) != 0x6)
+		return SIMD_SSE2;
+
+	// Leaf 7 reports AVX2 and AVX-512 foundation
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return SIMD_SSE2;
+
+	__cpuidex(info, 7, 0);
+	const bool avx2 = (info[1] & (1 << 5)) != 0;
+	const bool avx512 = (info[1] & (1 << 16)) != 0;
+
+	if (avx512 && (xcr0 & 0xE6) == 0xE6)
+		return SIMD_AVX512;
+
+	return avx2 ? SIMD_AVX2 : SIMD_SSE2;
+}
+
+static SIMDMemKernels MakeSIMDMemKernels(SIMDLevel level)
+{
+	switch (level)
+	{
+	case SIMD_AVX512:
+		return { SIMD_AVX512, AVX512MemCopy, AVX512MemStream, AVX512MemSet };
+	case SIMD_AVX2:
+		return { SIMD_AVX2, AVX2MemCopy, AVX2MemStream, AVX2MemSet };
+	default:
+		return { SIMD_SSE2, SSE2MemCopy, SSE2MemStream, SSE2MemSet };
+	}
+}
+
+static SIMDMemKernels& GetSIMDMemKernels()
+{
+	// Selected once on first use
+	static SIMDMemKernels kernels = MakeSIMDMemKernels(GetSupportedSIMDLevel());
+
+	return kernels;
+}
+
+SIMDLevel GetSupportedSIMDLevel()
+{
+	static const SIMDLevel level = DetectSIMDLevel();
+
+	return level;
+}
+
+SIMDLevel GetSIMDLevel()
+{
+	return GetSIMDMemKernels()._level;
+}
+
+void SetSIMDLevel(SIMDLevel level)
+{
+	// We cannot run instructions the processor does not have
+	assert(level <= GetSupportedSIMDLevel());
+
+	GetSIMDMemKernels() = MakeSIMDMemKernels(level);
+}
+
+size_t GetSIMDStreamingThreshold()
+{
+	return STREAMING_THRESHOLD;
+}
+
+void SetSIMDStreamingThreshold(size_t num_chunks)
+{
+	STREAMING_THRESHOLD = num_chunks;
+}
 
 void SIMDMemCopy(void* target, void* source, size_t num_chunks)
 {
@@ -42,24 +362,25 @@ void SIMDMemCopy(void* target, void* source, size_t num_chunks)
 	assert(!((reinterpret_cast<intptr_t>(target) & 15)));
 	assert(!((reinterpret_cast<intptr_t>(source) & 15)));
 
+	// Overlapping regions are copied front to back
+	assert(target <= source || static_cast<__m128i*>(source) + num_chunks <= target);
+
 	// Interpret the addresses as a bunch of bytes
 	auto t = static_cast<__m128i*>(target);
-	auto s = static_cast<__m128i*>(source);
+	auto s = static_cast<const __m128i*>(source);
 
-	// Start copying the source to the target addresses
-	for (size_t i = 0; i < num_chunks; i++, t++, s++)
+	// Large copies bypass the caches so they do not evict the working set. An overlapping target is 
+	// already cached by reading the source, and streaming into it would only flush those lines
+	if (num_chunks >= STREAMING_THRESHOLD && (s + num_chunks <= t || t + num_chunks <= s))
 	{
-		// Check that the given addresses are 16 byte aligned
-		assert(!((reinterpret_cast<intptr_t>(t)& 15)));
-		assert(!((reinterpret_cast<intptr_t>(s)& 15)));
+		GetSIMDMemKernels()._stream(t, s, num_chunks);
 
-		// Load chunk from source address
-		const __m128i chunk = _mm_load_si128(s);
-		//__m128i chunk = _mm_stream_load_si128(s);
-
-		// Store chunk into target address
-		_mm_store_si128(t, chunk);
-		//_mm_stream_si128(t, chunk);
+		// Order the streaming stores before anything that follows the copy
+		_mm_sfence();
+	}
+	else
+	{
+		GetSIMDMemKernels()._copy(t, s, num_chunks);
 	}
 }
 
@@ -79,12 +400,5 @@ void SIMDMemSet(void* target, int pattern, size_t num_chunks)
 	_declspec(align(16)) const int p[] = { pattern, pattern, pattern, pattern };
 	const __m128i chunk = _mm_load_si128(reinterpret_cast<const __m128i*>(&p));
 
-	// Start setting the target region in memory to the pattern register
-	for (size_t i = 0; i < num_chunks; i++, t++)
-	{
-		// Check that the given addresses are 16 byte aligned
-		assert(!((reinterpret_cast<intptr_t>(target)& 15)));
-
-		_mm_store_si128(t, chunk);
-	}
+	GetSIMDMemKernels()._set(t, chunk, num_chunks);
 }
\ No newline at end of file
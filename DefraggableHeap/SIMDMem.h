@@ -26,6 +26,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+/**
+*	The instruction sets the SIMD memory routines can run their loops on, ordered by register width.
+*/
+enum SIMDLevel
+{
+	/**< 16 byte registers, available on every x64 processor. */
+	SIMD_SSE2 = 0,
+
+	/**< 32 byte registers. */
+	SIMD_AVX2 = 1,
+
+	/**< 64 byte registers. */
+	SIMD_AVX512 = 2
+};
+
 /**
 *	Copies regions on memory using SIMD operations. 
 *	All addresses must be 16-byte aligned.
@@ -33,6 +48,10 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 *	If the target region overlaps with the source region,
 *	the source region will be overwritten. The target region
 *	will contain valid data, the source region will be undefined.
+*	Overlapping regions are only supported when the target is below the source.
+*
+*	Copies of at least the streaming threshold into a target that does not overlap the source use
+*	non-temporal stores, so moving a large block does not evict the rest of the working set from the caches.
 *
 *	@param target the address that we want to copy memory to
 *	@param source the address that we want to copy memory from
@@ -48,4 +67,41 @@ void SIMDMemCopy(void* target, void* source, size_t num_chunks);
 *	@param pattern the pattern to set memory to
 *	@param num_chunks the number of SIMD chunks to set
 */
-void SIMDMemSet(void* target, int pattern, size_t num_chunks);
\ No newline at end of file
+void SIMDMemSet(void* target, int pattern, size_t num_chunks);
+
+/**
+*	Gets the widest instruction set the processor and operating system support, queried once with CPUID.
+*
+*	@returns the widest supported SIMD level
+*/
+SIMDLevel GetSupportedSIMDLevel();
+
+/**
+*	Gets the instruction set the SIMD memory routines currently run on.
+*
+*	@returns the active SIMD level
+*/
+SIMDLevel GetSIMDLevel();
+
+/**
+*	Sets the instruction set the SIMD memory routines run on. Defaults to the widest supported level,
+*	lowering it is only useful for benchmarking the narrower loops.
+*
+*	@param level the SIMD level to use, must not be wider than the supported level
+*/
+void SetSIMDLevel(SIMDLevel level);
+
+/**
+*	Gets the number of chunks above which SIMDMemCopy uses non-temporal stores.
+*
+*	@returns the streaming threshold in chunks
+*/
+size_t GetSIMDStreamingThreshold();
+
+/**
+*	Sets the number of chunks above which SIMDMemCopy uses non-temporal stores.
+*	Copies this large are expected to miss the caches anyway, streaming them keeps the working set cached.
+*
+*	@param num_chunks the streaming threshold in chunks, SIZE_MAX to never stream
+*/
+void SetSIMDStreamingThreshold(size_t num_chunks);
\ No newline at end of file
@@ -68,4 +68,27 @@ _declspec(align(16)) struct SplayHeader
 	IndexType _max_contiguous_free_chunks;
 };
 
-static_assert(sizeof(SplayHeader) == 16, "The block header needs to be 16 bytes in size.");
\ No newline at end of file
+static_assert(sizeof(SplayHeader) == 16, "The block header needs to be 16 bytes in size.");
+
+/**
+*	Defines a node in the size ordered index of free blocks.
+*
+*	Nodes are stored in the first payload chunk of the free block they index, 
+*	so only free blocks with at least one payload chunk can be indexed.
+*/
+_declspec(align(16)) struct SizeIndexNode
+{
+	/**< Index of the left subtree, holding smaller keys. */
+	IndexType _left;
+
+	/**< Index of the right subtree, holding larger keys. */
+	IndexType _right;
+
+	/**< The number of chunks in the indexed free block, the primary key of the node. */
+	IndexType _num_chunks;
+
+	/**< Unused padding. */
+	IndexType _unused;
+};
+
+static_assert(sizeof(SizeIndexNode) == 16, "The size index node needs to fit in a single chunk.");
\ No newline at end of file
@@ -36,10 +36,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <algorithm>
 
 #include <deque>
+#include <thread>
+#include <vector>
 
 #include "SplayHeader.h"
 
-SplayHeap::SplayHeap(size_t size)
+template <typename Policies>
+SplayHeapEngine<Policies>::SplayHeapEngine(size_t size, HeaderLayout layout)
 {
 	// Make sure heap size is multiples of 16 bytes
 	static const size_t mask = 16 - 1;
@@ -57,7 +60,11 @@ SplayHeap::SplayHeap(size_t size)
 	assert(_num_chunks <= (IndexType(-1) >> 1));
 
 	// Allocate the system heap
+	// Out of band headers get their own array so payloads stay contiguous
+	_header_chunks = layout == INLINE_HEADERS ? 1 : 0;
 	_heap = static_cast<SplayHeader*>(AlignedNew(total_size, 16));
+	_data = _header_chunks ? reinterpret_cast<HeapChunk*>(_heap) 
+		: static_cast<HeapChunk*>(AlignedNew(total_size, 16));
 
 	// Setup the null sentinel node
 	new (&_heap[NULL_INDEX]) SplayHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED);
@@ -71,15 +78,25 @@ SplayHeap::SplayHeap(size_t size)
 	new (&_heap[_root_index]) SplayHeader(NULL_INDEX, NULL_INDEX, _free_chunks, FREE);
 	UpdateNodeStatistics(_heap[_root_index]);
 
+	// The wilderness starts attached to the tree
+	_wilderness_index = _bump_index = _num_chunks;
+	_rover_index = _root_index;
+	_rebalance_phase = REBALANCE_START;
+	_defrag_on_allocate_failure = false;
+
 	// Debug set free chunks in the heap
-#ifdef _DEBUG
-		SIMDMemSet(&_heap[_root_index + 1], INIT_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), INIT_PATTERN, GetBlockDataChunks(_root_index));
+
+	// Index the root block, after the debug fill as a size index node lives in the payload
+	_size_root_index = NULL_INDEX;
+	IndexFreeBlock(_root_index);
 
 		AssertHeapInvariants();
 }
 
-void SplayHeap::UpdateNodeStatistics(SplayHeader &node)
+template <typename Policies>
+void SplayHeapEngine<Policies>::UpdateNodeStatistics(SplayHeader &node)
 {
 	// The maximum free contiguous block for the current node
 	// is a 3 way maximum of of children and max of self if we are a free block
@@ -93,17 +110,34 @@ void SplayHeap::UpdateNodeStatistics(SplayHeader &node)
 			node._block_metadata._num_chunks);
 }
 
-SplayHeap::~SplayHeap()
+template <typename Policies>
+SplayHeapEngine<Policies>::~SplayHeapEngine()
 {
 	AssertHeapInvariants();
 
 	_pointer_list.RemoveAll();
 
 	// Delete the system heap
+	if (static_cast<void*>(_data) != static_cast<void*>(_heap))
+		AlignedDelete(_data);
+
 	AlignedDelete(_heap);
 }
 
-float SplayHeap::FragmentationRatio() const
+template <typename Policies>
+HeapChunk* SplayHeapEngine<Policies>::GetBlockData(IndexType index) const
+{
+	return &_data[index + _header_chunks];
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::GetBlockDataChunks(IndexType index) const
+{
+	return _heap[index]._block_metadata._num_chunks - _header_chunks;
+}
+
+template <typename Policies>
+float SplayHeapEngine<Policies>::FragmentationRatio() const
 {
 	AssertHeapInvariants();
 
@@ -114,13 +148,14 @@ float SplayHeap::FragmentationRatio() const
 
 	// Get free chunks statistics
 	const auto free = static_cast<float>(_free_chunks);
-	const auto free_max = static_cast<float>(_heap[_root_index]._max_contiguous_free_chunks);
+	const auto free_max = static_cast<float>(GetMaxContiguousFreeChunks());
 	
 	// Calculate free chunks ratio to determine fragmentation
 	return (free - free_max) / free;
 }
 
-IndexType SplayHeap::RotateWithLeftChild( IndexType k2 )
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::RotateWithLeftChild( IndexType k2 )
 {
 	// Get left subtree
 	auto k1 = _heap[k2]._left;
@@ -145,7 +180,8 @@ IndexType SplayHeap::RotateWithLeftChild( IndexType k2 )
 }
 
 
-IndexType SplayHeap::RotateWithRightChild( IndexType k1 )
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::RotateWithRightChild( IndexType k1 )
 {
 	// Promote right subtree
 	auto k2 = _heap[ k1 ]._right;
@@ -169,7 +205,8 @@ IndexType SplayHeap::RotateWithRightChild( IndexType k1 )
 	return k2;
 }
 
-IndexType SplayHeap::FindFreeBlock( IndexType t, IndexType num_chunks ) const
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const
 {
 	AssertHeapInvariants();
 
@@ -197,8 +234,293 @@ IndexType SplayHeap::FindFreeBlock( IndexType t, IndexType num_chunks ) const
 	return t;
 }
 
-IndexType SplayHeap::Splay(IndexType value, IndexType t)
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy )
+{
+	assert(t == _root_index);
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Splay the rover to the root, the blocks after it are now the root and its right subtree
+	_root_index = Splay(_rover_index, t);
+	auto &root = _heap[_root_index];
+
+	// Is the root after the rover and big enough
+	if (_root_index >= _rover_index && !root._block_metadata._is_allocated && 
+		root._block_metadata._num_chunks >= num_chunks)
+		return _root_index;
+
+	// Does the right subtree contain a free block large enough
+	if (_heap[root._right]._max_contiguous_free_chunks >= num_chunks)
+		return FindFreeBlock(root._right, num_chunks, FirstFitPolicy());
+
+	// Wrap around to the start of the heap
+	return FindFreeBlock(_root_index, num_chunks, FirstFitPolicy());
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, BestFitPolicy )
+{
+	assert(t == _root_index);
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Splay the smallest possible key for the size, no block lives at the null index
+	_size_root_index = SplaySizeIndex(num_chunks, NULL_INDEX, _size_root_index);
+	auto &root = GetSizeIndexNode(_size_root_index);
+
+	// The root is either the best fit or the largest block that is too small
+	if (root._num_chunks >= num_chunks)
+		return _size_root_index;
+
+	// The best fit is the minimum of the right subtree
+	root._right = SplaySizeIndex(num_chunks, NULL_INDEX, root._right);
+	assert(root._right);
+
+	return root._right;
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, IndexedFirstFitPolicy ) const
+{
+	assert(t == _root_index);
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// The index reads a few cache lines instead of a header per tree level
+	const auto free_block = _free_index.FindFirstFit(num_chunks);
+	assert(free_block == FindFreeBlock(t, num_chunks, FirstFitPolicy()));
+
+	return free_block;
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindFreeBlock( IndexType t, IndexType num_chunks, PackedFirstFitPolicy ) const
+{
+	// The packed index answers through the same interface
+	return FindFreeBlock(t, num_chunks, IndexedFirstFitPolicy());
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::FindLastFreeBlock( IndexType t, IndexType num_chunks ) const
+{
+	AssertHeapInvariants();
+
+	// Is there even enough space in the tree to make an allocation
+	if (_heap[t]._max_contiguous_free_chunks < num_chunks)
+		return NULL_INDEX;
+
+	// Traverse down tree until we find a free block large enough
+	while ( t )
+	{
+		auto &n = _heap [ t ];
+
+		// Does the right subtree contain a free block large enough
+		if ( _heap [ n._right ]._max_contiguous_free_chunks >= num_chunks )
+			t = n._right;
+		// Is the current block free and big enough?
+		else if ( !n._block_metadata._is_allocated && n._block_metadata._num_chunks >= num_chunks )
+			break;
+		// The left subtree must contain the free block
+		else
+			t = n._left;
+	}
+
+	// Return found index
+	return t;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::IndexFreeBlock(IndexType index)
+{
+	if (FitPolicy::BEST_FIT)
+		InsertSizeIndex(index);
+
+	if (FitPolicy::INDEXED)
+		_free_index.Insert(index, _heap[index]._block_metadata._num_chunks);
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::UnindexFreeBlock(IndexType index)
+{
+	if (FitPolicy::BEST_FIT)
+		RemoveSizeIndex(index);
+
+	if (FitPolicy::INDEXED)
+		_free_index.Remove(index);
+}
+
+template <typename Policies>
+SizeIndexNode& SplayHeapEngine<Policies>::GetSizeIndexNode(IndexType index) const
+{
+	return *reinterpret_cast<SizeIndexNode*>(GetBlockData(index));
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::InsertSizeIndex(IndexType index)
+{
+	assert(!_heap[index]._block_metadata._is_allocated);
+
+	// Blocks without a payload chunk can never fit an allocation
+	if (!GetBlockDataChunks(index))
+		return;
+
+	auto &node = GetSizeIndexNode(index);
+	node._num_chunks = _heap[index]._block_metadata._num_chunks;
+	node._left = node._right = NULL_INDEX;
+
+	// Is the index empty
+	if (_size_root_index == NULL_INDEX)
+	{
+		_size_root_index = index;
+		return;
+	}
+
+	// Splay the neighbour of the new key to the root and split the index around it
+	const auto t = SplaySizeIndex(node._num_chunks, index, _size_root_index);
+	auto &root = GetSizeIndexNode(t);
+
+	if (node._num_chunks < root._num_chunks || (node._num_chunks == root._num_chunks && index < t))
+	{
+		node._left = root._left;
+		node._right = t;
+		root._left = NULL_INDEX;
+	}
+	else
+	{
+		node._right = root._right;
+		node._left = t;
+		root._right = NULL_INDEX;
+	}
+
+	_size_root_index = index;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::RemoveSizeIndex(IndexType index)
+{
+	assert(!_heap[index]._block_metadata._is_allocated);
+
+	// Blocks without a payload chunk are never indexed
+	if (!GetBlockDataChunks(index))
+		return;
+
+	// Splay the node to the root of the index
+	const auto num_chunks = GetSizeIndexNode(index)._num_chunks;
+	_size_root_index = SplaySizeIndex(num_chunks, index, _size_root_index);
+	assert(_size_root_index == index);
+
+	auto &root = GetSizeIndexNode(index);
+
+	// Join the subtrees, every key in the left subtree is smaller so its maximum is splayed up
+	if (root._left == NULL_INDEX)
+		_size_root_index = root._right;
+	else
+	{
+		_size_root_index = SplaySizeIndex(num_chunks, index, root._left);
+		GetSizeIndexNode(_size_root_index)._right = root._right;
+	}
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::SplaySizeIndex(IndexType num_chunks, IndexType index, IndexType t)
+{
+	if (t == NULL_INDEX)
+		return NULL_INDEX;
+
+	// Keys order by size then by address
+	auto less = [&](IndexType a, IndexType b) {
+		const auto a_chunks = a ? GetSizeIndexNode(a)._num_chunks : num_chunks;
+		const auto b_chunks = b ? GetSizeIndexNode(b)._num_chunks : num_chunks;
+		return a_chunks < b_chunks || (a_chunks == b_chunks && (a ? a : index) < (b ? b : index));
+	};
+
+	// Setup splay tracking state, the null index stands for the searched key
+	SizeIndexNode header = { NULL_INDEX, NULL_INDEX, 0, 0 };
+	SizeIndexNode *left_tree_max = &header, *right_tree_min = &header;
+
+	// Continually rotate the tree until we splay the desired key
+	while (true)
+	{
+		auto *n = &GetSizeIndexNode(t);
+
+		// Is the desired key in the left subtree
+		if (less(NULL_INDEX, t))
+		{
+			if (n->_left == NULL_INDEX)
+				break;
+
+			// If the desired key is in the left subtree of the left child rotate it up
+			if (less(NULL_INDEX, n->_left))
+			{
+				const auto k1 = n->_left;
+				auto &n1 = GetSizeIndexNode(k1);
+				n->_left = n1._right;
+				n1._right = t;
+				t = k1;
+				n = &n1;
+
+				if (n->_left == NULL_INDEX)
+					break;
+			}
+
+			// Link right state tree
+			right_tree_min->_left = t;
+			right_tree_min = n;
+			t = n->_left;
+		}
+		// Is the desired key in the right subtree
+		else if (less(t, NULL_INDEX))
+		{
+			if (n->_right == NULL_INDEX)
+				break;
+
+			// If the desired key is in the right subtree of the right child rotate it up
+			if (less(n->_right, NULL_INDEX))
+			{
+				const auto k2 = n->_right;
+				auto &n2 = GetSizeIndexNode(k2);
+				n->_right = n2._left;
+				n2._left = t;
+				t = k2;
+				n = &n2;
+
+				if (n->_right == NULL_INDEX)
+					break;
+			}
+
+			// Link left state tree
+			left_tree_max->_right = t;
+			left_tree_max = n;
+			t = n->_right;
+		}
+		// Is the desired key at the root
+		else
+			break;
+	}
+
+	// Rebuild the tree around the new root
+	auto &n = GetSizeIndexNode(t);
+	left_tree_max->_right = n._left;
+	right_tree_min->_left = n._right;
+	n._left = header._right;
+	n._right = header._left;
+
+	return t;
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::Splay(IndexType value, IndexType t)
 {
+	// Splaying reshapes the tree and reuses the splay header, any rebalance pass starts over
+	_rebalance_phase = REBALANCE_START;
+
 	// Setup splay tracking state
 	new (&_heap[SPLAY_HEADER_INDEX]) SplayHeader(NULL_INDEX, NULL_INDEX, 1, ALLOCATED);
 	IndexType left_tree_max = SPLAY_HEADER_INDEX, right_tree_min = SPLAY_HEADER_INDEX;
@@ -302,7 +624,8 @@ IndexType SplayHeap::Splay(IndexType value, IndexType t)
 	return t;
 }
 
-DefraggablePointerControlBlock SplayHeap::Allocate(size_t num_bytes)
+template <typename Policies>
+DefraggablePointerControlBlock SplayHeapEngine<Policies>::Allocate(size_t num_bytes)
 {
 	AssertHeapInvariants();
 	// An allocation of 0 bytes is redundant
@@ -312,19 +635,177 @@ DefraggablePointerControlBlock SplayHeap::Allocate(size_t num_bytes)
 	// Calculate the number of chunks required to fulfil the request
 	const size_t mask = 16 - 1;
 	const auto offset = (16 - (num_bytes & mask)) & mask;
-	const IndexType required_chunks = ((num_bytes + offset) / 16) + 1;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunks(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock SplayHeapEngine<Policies>::AllocateChunks(IndexType required_chunks)
+{
 	assert(required_chunks);
 
-	// Do we have enough contiguous space for the allocation
-	if (_heap[_root_index]._max_contiguous_free_chunks < required_chunks)
-		return nullptr;
+	// Can the tree fit the allocation, if not bump it off the wilderness
+	// The wilderness is always the highest addressed block so this respects first fit
+	// A rover inside the wilderness means next fit would pick the wilderness first as well
+	if (_heap[_root_index]._max_contiguous_free_chunks < required_chunks ||
+		(FitPolicy::ROVING && _rover_index >= _wilderness_index && _num_chunks - _bump_index >= required_chunks))
+	{
+		// Do we have enough contiguous space for the allocation
+		if (_num_chunks - _bump_index < required_chunks)
+		{
+			// Is there enough free space in total to make room for the allocation
+			if (!_defrag_on_allocate_failure || _free_chunks < required_chunks)
+				return nullptr;
+
+			DefragForAllocation(required_chunks);
+			return AllocateChunks(required_chunks);
+		}
+
+		return BumpAllocate(required_chunks);
+	}
 
 	// Splay the found free block to the root
-	const auto free_block = FindFreeBlock(_root_index, required_chunks);
+	const auto free_block = FindFreeBlock(_root_index, required_chunks, FitPolicy());
 	assert(free_block);
 	_root_index = Splay(free_block, _root_index);
 	AssertHeapInvariants();
 
+	// The found block is no longer free
+	UnindexFreeBlock(free_block);
+
+	// Is the found block the trailing free block of the heap
+	if (free_block + _heap[free_block]._block_metadata._num_chunks == _num_chunks)
+	{
+		// The trailing block is the maximum so it has no right subtree
+		// Detach it from the tree so we can bump allocate from it
+		assert(_heap[free_block]._right == NULL_INDEX);
+		_root_index = _heap[free_block]._left;
+		_wilderness_index = _bump_index = free_block;
+
+		return BumpAllocate(required_chunks);
+	}
+
+	const auto old_index = AllocateRootBlock(required_chunks);
+
+	// Possible strict aliasing problem?
+	return _pointer_list.Create(GetBlockData(old_index));
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock SplayHeapEngine<Policies>::Allocate(size_t num_bytes, LifetimeHint hint)
+{
+	// Long lived blocks are placed by the fit policy
+	if (hint == LONG_LIVED)
+		return Allocate(num_bytes);
+
+	AssertHeapInvariants();
+	// An allocation of 0 bytes is redundant
+	if (!num_bytes)
+		return nullptr;
+
+	// Calculate the number of chunks required to fulfil the request
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const IndexType required_chunks = IndexType((num_bytes + offset) / 16) + _header_chunks;
+
+	return AllocateChunksFromTop(required_chunks);
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock SplayHeapEngine<Policies>::AllocateChunksFromTop(IndexType required_chunks)
+{
+	assert(required_chunks);
+
+	// The top of the heap may be in the detached wilderness, put it back in the tree
+	FoldWilderness();
+
+	// Find the highest free block that fits
+	const auto free_block = FindLastFreeBlock(_root_index, required_chunks);
+
+	// Did we fail to find a suitable free block
+	if (!free_block)
+	{
+		// Is there enough free space in total to make room for the allocation
+		if (!_defrag_on_allocate_failure || _free_chunks < required_chunks)
+			return nullptr;
+
+		DefragForAllocation(required_chunks);
+		return AllocateChunksFromTop(required_chunks);
+	}
+
+	// Splay the found free block to the root
+	_root_index = Splay(free_block, _root_index);
+	AssertHeapInvariants();
+
+	// The found block is no longer free
+	UnindexFreeBlock(free_block);
+
+	const auto block = AllocateRootBlockFromTop(required_chunks);
+
+	return _pointer_list.Create(GetBlockData(block));
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::AllocateRootBlockFromTop(IndexType required_chunks)
+{
+	assert(!_heap[_root_index]._block_metadata._is_allocated);
+	assert(_heap[_root_index]._block_metadata._num_chunks >= required_chunks);
+
+	// Calculate the number of chunks left free below the allocation
+	const auto raw_free_chunks = _heap[_root_index]._block_metadata._num_chunks
+		- required_chunks;
+
+	// An exact fit takes the whole block
+	if (!raw_free_chunks)
+		return AllocateRootBlock(required_chunks);
+
+	/* Shrink the root free block in place and make the allocated block above it the new root */
+
+	auto &old_root = _heap[_root_index];
+	old_root._block_metadata._num_chunks = raw_free_chunks;
+	_free_chunks -= required_chunks;
+
+	// Create the header for the allocated block
+	// New address value will always be bigger since 
+	// we allocate to the higher addresses
+	// Left subtree is the shrunk free block
+	const auto block = _root_index + raw_free_chunks;
+	new (&_heap[block]) SplayHeader(
+			_root_index, 
+			old_root._right,
+			required_chunks, 
+			ALLOCATED
+		);
+
+	// Clear right subtree of old root
+	old_root._right = NULL_INDEX;
+
+	// Update old root node statistics
+	UpdateNodeStatistics(old_root);
+
+	IndexFreeBlock(_root_index);
+
+	// Set new root
+	_root_index = block;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(block), ALLOC_PATTERN, GetBlockDataChunks(block));
+
+	// Update root node statistics
+	UpdateNodeStatistics(_heap[_root_index]);
+
+	AssertHeapInvariants();
+
+	return block;
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::AllocateRootBlock(IndexType required_chunks)
+{
+	assert(!_heap[_root_index]._block_metadata._is_allocated);
+	assert(_heap[_root_index]._block_metadata._num_chunks >= required_chunks);
+
 	/* Split the root free block into two, one allocated block and one free block */
 
 	// Calculate the new raw free block size
@@ -336,9 +817,12 @@ DefraggablePointerControlBlock SplayHeap::Allocate(size_t num_bytes)
 	_heap[old_index]._block_metadata = { ALLOCATED, required_chunks };
 	_free_chunks -= required_chunks;
 
-#ifdef _DEBUG
-		SIMDMemSet(&_heap[_root_index + 1], ALLOC_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+	// Continue searching from after this allocation
+	if (FitPolicy::ROVING)
+		_rover_index = old_index + required_chunks;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), ALLOC_PATTERN, GetBlockDataChunks(_root_index));
 
 	// Is there a new free block to add to the tree
 	if (raw_free_chunks)
@@ -368,10 +852,10 @@ DefraggablePointerControlBlock SplayHeap::Allocate(size_t num_bytes)
 		// Set new root
 		_root_index = new_free_index;
 
-#ifdef _DEBUG
-			SIMDMemSet(&_heap[_root_index + 1], SPLIT_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(_root_index), SPLIT_PATTERN, GetBlockDataChunks(_root_index));
 
+		IndexFreeBlock(_root_index);
 	}
 
 	// Update root node statistics
@@ -379,11 +863,74 @@ DefraggablePointerControlBlock SplayHeap::Allocate(size_t num_bytes)
 
 	AssertHeapInvariants();
 
-	// Possible strict aliasing problem?
-	return _pointer_list.Create(&_heap[old_index + 1]);
+	return old_index;
+}
+
+template <typename Policies>
+DefraggablePointerControlBlock SplayHeapEngine<Policies>::BumpAllocate(IndexType required_chunks)
+{
+	const auto wilderness_chunks = _num_chunks - _bump_index;
+	assert(wilderness_chunks >= required_chunks);
+
+	// Carve the allocated block off the front of the wilderness
+	const auto block = _bump_index;
+	new (&_heap[block]) SplayHeader(NULL_INDEX, NULL_INDEX, required_chunks, ALLOCATED);
+	_bump_index += required_chunks;
+	_free_chunks -= required_chunks;
+
+	// Continue searching from after this allocation
+	if (FitPolicy::ROVING)
+		_rover_index = _bump_index;
+
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(block), ALLOC_PATTERN, GetBlockDataChunks(block));
+
+	// Write the header for the remaining wilderness
+	if (_bump_index < _num_chunks)
+		new (&_heap[_bump_index]) SplayHeader(NULL_INDEX, NULL_INDEX, wilderness_chunks - required_chunks, FREE);
+
+	AssertHeapInvariants();
+
+	return _pointer_list.Create(GetBlockData(block));
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::FoldWilderness()
+{
+	// Is there a detached wilderness to fold back
+	if (_wilderness_index == _num_chunks)
+		return;
+
+	// Every block in the wilderness is bigger than any node in the tree
+	// Make each block the new root with the old tree as its left subtree
+	for (auto index = _wilderness_index; index < _num_chunks; index += _heap[index]._block_metadata._num_chunks)
+	{
+		_heap[index]._left = _root_index;
+		_heap[index]._right = NULL_INDEX;
+		UpdateNodeStatistics(_heap[index]);
+
+		_root_index = index;
+
+		// The trailing free block is tracked by the free block indices again
+		if (!_heap[index]._block_metadata._is_allocated)
+			IndexFreeBlock(index);
+	}
+
+	// The whole heap is in the tree again
+	_wilderness_index = _bump_index = _num_chunks;
+	_rebalance_phase = REBALANCE_START;
+
+	AssertHeapInvariants();
 }
 
-void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::GetMaxContiguousFreeChunks() const
+{
+	return std::max(_heap[_root_index]._max_contiguous_free_chunks, _num_chunks - _bump_index);
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::Free(DefraggablePointerControlBlock& ptr)
 {
 	AssertHeapInvariants();
 	void* data = ptr.Get();
@@ -393,33 +940,44 @@ void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
 		return;
 
 	// Get the offset of the pointer into the heap
-	const auto block_addr = static_cast<SplayHeader*>(data);
-	const std::ptrdiff_t offset = block_addr - _heap;
+	const auto block_addr = static_cast<HeapChunk*>(data);
+	const std::ptrdiff_t offset = block_addr - _data;
 
 	// Is the offset in a valid range
-	if ( offset < 0 || offset >= ptrdiff_t( _num_chunks ) )
+	if ( offset < ptrdiff_t( _header_chunks ) || offset >= ptrdiff_t( _num_chunks ) )
 		return;
 
 	// Is the data pointer of expected alignment
-	if (block_addr != &_heap[offset])
+	if (block_addr != &_data[offset])
 		return;
 
+	// Invalidate defraggable pointers that point into the block before we invalidate data in the heap
+	const auto index = IndexType(offset) - _header_chunks;
+	if (PointerPolicy::INVALIDATE_ALIASES)
+		_pointer_list.RemovePointersInRange(&_data[index], &_data[index + _heap[index]._block_metadata._num_chunks]);
+	else
+		ptr = nullptr;
+
+	FreeBlock(index);
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::FreeBlock(IndexType index)
+{
+	// Freed blocks need their neighbours in the tree
+	FoldWilderness();
+
 	// Splay the block to free to the root of the tree
-	_root_index = Splay(offset - 1, _root_index);
+	_root_index = Splay(index, _root_index);
 	AssertHeapInvariants();
+	assert(_root_index == index && _heap[_root_index]._block_metadata._is_allocated);
 
 	// Mark the root as being free
 	_heap[_root_index]._block_metadata._is_allocated = FREE;
 	_free_chunks += _heap[_root_index]._block_metadata._num_chunks;
-	
-
-	// Invalidate defraggable pointers that point into the root block before we invalidate data in the heap
-//	RemovePointersInRange(_root_index, _root_index + _heap[_root_index]._block_metadata._num_chunks);
-	_pointer_list.RemovePointersInRange(&_heap[_root_index], &_heap[_root_index + _heap[_root_index]._block_metadata._num_chunks]);
 
-#ifdef _DEBUG
-		SIMDMemSet(&_heap[_root_index + 1], FREED_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), FREED_PATTERN, GetBlockDataChunks(_root_index));
 
 	// We may have invalidated our invariant of having no two free adjacent blocks
 	// Collapse adjacent free blocks in the heap to restore the invariant
@@ -432,6 +990,9 @@ void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
 		// Is the root of the left subtree a free block
 		if (!_heap[left]._block_metadata._is_allocated)
 		{
+			// The merged block is reindexed with its new size
+			UnindexFreeBlock(left);
+
 			// Copy down block metadata and right subtree
 			_heap[left]._right = _heap[_root_index]._right;
 			_heap[left]._block_metadata._num_chunks += 
@@ -440,9 +1001,8 @@ void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
 			// Make the left root the new tree root
 			_root_index = left;
 
-#ifdef _DEBUG
-				SIMDMemSet(&_heap[_root_index + 1], MERGE_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+			if (DebugPolicy::FILL_PATTERNS)
+				SIMDMemSet(GetBlockData(_root_index), MERGE_PATTERN, GetBlockDataChunks(_root_index));
 		}
 		// Previous block is allocated, fix up pointers
 		else
@@ -458,14 +1018,16 @@ void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
 		// Is the root of the right subtree a free block
 		if (!_heap[right]._block_metadata._is_allocated)
 		{
+			// The merged block is reindexed with its new size
+			UnindexFreeBlock(right);
+
 			// Copy up block metadata and new right subtree
 			_heap[_root_index]._right = _heap[right]._right;
 			_heap[_root_index]._block_metadata._num_chunks += 
 				_heap[right]._block_metadata._num_chunks;
 
-#ifdef _DEBUG
-				SIMDMemSet(&_heap[_root_index + 1], MERGE_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+			if (DebugPolicy::FILL_PATTERNS)
+				SIMDMemSet(GetBlockData(_root_index), MERGE_PATTERN, GetBlockDataChunks(_root_index));
 		}
 		// Next block is allocated, fix up pointers
 		else
@@ -475,10 +1037,14 @@ void SplayHeap::Free(DefraggablePointerControlBlock& ptr)
 	// Update root node statistics
 	UpdateNodeStatistics(_heap[_root_index]);
 
+	// Index the final free block now every debug fill of its payload is done
+	IndexFreeBlock(_root_index);
+
 	AssertHeapInvariants();
 }
 
-void SplayHeap::FullDefrag()
+template <typename Policies>
+void SplayHeapEngine<Policies>::FullDefrag()
 {
 	AssertHeapInvariants();
 	while (!IterateHeap())
@@ -486,68 +1052,116 @@ void SplayHeap::FullDefrag()
 	AssertHeapInvariants();
 }
 
-bool SplayHeap::IsFullyDefragmented() const
+template <typename Policies>
+bool SplayHeapEngine<Policies>::IsFullyDefragmented() const
 {
 	AssertHeapInvariants();
-	return _heap[_root_index]._max_contiguous_free_chunks == _free_chunks;
+	return GetMaxContiguousFreeChunks() == _free_chunks;
 }
 
-bool SplayHeap::IterateHeap()
+template <typename Policies>
+bool SplayHeapEngine<Policies>::IterateHeap()
 {
 	AssertHeapInvariants();
 	// Do we actually need to defrag the heap
 	if (IsFullyDefragmented())
 		return true;
 
-	// Splay the first free block in the heap to the root
-	// This will put the fully defragmented subheap in the left subtree
-	const auto free_block = FindFreeBlock(_root_index, 1);
+	// Compaction walks the exact block structure
+	FoldWilderness();
+
+	// Slide the blocks after the first free block in the heap down
+	SlideRun(FindFreeBlock(_root_index, 1, FirstFitPolicy()));
+
+	return IsFullyDefragmented();
+}
+
+template <typename Policies>
+IndexType SplayHeapEngine<Policies>::SlideRun(IndexType free_block)
+{
+	// Splay the free block to the root
+	// This will put the subheap before it in the left subtree
 	_root_index = Splay(free_block, _root_index);
+	assert(!_heap[_root_index]._block_metadata._is_allocated);
 	AssertHeapInvariants();
+
+	// The free block is about to be overwritten by the moved block
+	UnindexFreeBlock(free_block);
 	
-	// Splay the next block in the heap up from the right subtree
-	auto right = Splay(_root_index + 1, _heap[_root_index]._right);
-	assert(!_heap[right]._left);
+	// Find the end of the run of allocated blocks after the free block, the whole run moves at once
+	const auto free_chunks = _heap[_root_index]._block_metadata._num_chunks;
+	const auto alloc_block = _root_index + free_chunks;
+	auto run_end = alloc_block;
+	while (run_end < _num_chunks && _heap[run_end]._block_metadata._is_allocated)
+		run_end += _heap[run_end]._block_metadata._num_chunks;
 
 	// Our heap invariant means the next block must be allocated
-	assert(_heap[right]._block_metadata._is_allocated);
+	assert(run_end != alloc_block);
 
-	auto &root = _heap[_root_index];
-	auto &n = _heap[right];
+	// Splay the block after the run up from the right subtree, leaving the run alone in its left subtree
+	auto right = NULL_INDEX, run = _heap[_root_index]._right;
+	if (run_end < _num_chunks)
+	{
+		right = Splay(run_end, run);
+		run = _heap[right]._left;
+	}
 
-	// Update defraggable pointers before invalidating the heap
-	//OffsetPointersInRange(right, right + n._block_metadata._num_chunks, _root_index - right);
-	_pointer_list.OffsetPointersInRange(&_heap[right], &_heap[right + n._block_metadata._num_chunks], (ptrdiff_t(_root_index) - ptrdiff_t(right)) * 16);
+	// Splay the first block of the run to the top of the run subtree
+	run = Splay(alloc_block, run);
+	assert(!_heap[run]._left);
+
+	auto &root = _heap[_root_index];
 
-	// Create new free block header
-	SplayHeader new_free(NULL_INDEX, n._right, root._block_metadata._num_chunks, FREE);
-	const auto new_free_offset = _root_index + n._block_metadata._num_chunks;
+	// Update defraggable pointers before invalidating the heap, one pass for the whole run
+	_pointer_list.OffsetPointersInRange(&_data[alloc_block], &_data[run_end], -ptrdiff_t(free_chunks) * 16);
 
-	// Create new allocated block header
-	SplayHeader new_allocated(root._left, new_free_offset, n._block_metadata._num_chunks, ALLOCATED);
+	// Create new free block header, the moved run hangs off its left
+	const auto new_free_offset = run_end - free_chunks;
+	SplayHeader new_free(_root_index, right, free_chunks, FREE);
+	const auto left = root._left;
 
 	/* CONSIDER THE HEAP INVALID FROM HERE */
 
-	// Copy new allocated block header and move the data
-	SIMDMemCopy(&_heap[_root_index], &new_allocated, 1);
-	SIMDMemCopy(&_heap[_root_index + 1], &_heap[right + 1], 
-		new_allocated._block_metadata._num_chunks - 1);
+	// Move the run down in one copy, inline headers move along with their data
+	SIMDMemCopy(&_data[_root_index], &_data[alloc_block], run_end - alloc_block);
+
+	// Patch the moved headers in a single pass, out of band headers are moved here too
+	// The run subtree only links to itself so every child index slides with it
+	for (IndexType index = _root_index; index < new_free_offset; index += _heap[index]._block_metadata._num_chunks)
+	{
+		if (!_header_chunks)
+			_heap[index] = _heap[index + free_chunks];
+
+		auto &node = _heap[index];
+		assert(node._block_metadata._is_allocated);
+		if (node._left)
+			node._left -= free_chunks;
+		if (node._right)
+			node._right -= free_chunks;
+	}
+
+	// The first block of the run takes over the defragmented left subtree
+	_heap[_root_index]._left = left;
 
 	// Copy new free block header
 	SIMDMemCopy(&_heap[new_free_offset], &new_free, 1);
 
 	/* HEAP IS NOW VALID */
 
-	// Update new node statistics
-	UpdateNodeStatistics(_heap[new_free_offset]);
+	// Update node statistics, the rest of the run is allocated and keeps its statistics
+	if (right)
+	{
+		_heap[right]._left = NULL_INDEX;
+		UpdateNodeStatistics(_heap[right]);
+	}
 	UpdateNodeStatistics(_heap[_root_index]);
+	UpdateNodeStatistics(_heap[new_free_offset]);
 
-	// Rotate right child up to root
-	_root_index = RotateWithRightChild(_root_index);
+	// The moved free block is the new root
+	_root_index = new_free_offset;
 
-#ifdef _DEBUG
-		SIMDMemSet(&_heap[_root_index + 1], MOVE_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+	if (DebugPolicy::FILL_PATTERNS)
+		SIMDMemSet(GetBlockData(_root_index), MOVE_PATTERN, GetBlockDataChunks(_root_index));
 
 	// We possibly invalidated our heap invariant
 	// Does the right subtree contain any potential free blocks
@@ -559,6 +1173,9 @@ bool SplayHeap::IterateHeap()
 		// Is the root of the right subtree a free block
 		if (!_heap[right]._block_metadata._is_allocated)
 		{
+			// The merged block is reindexed with its new size
+			UnindexFreeBlock(right);
+
 			// Copy up block metadata and new right subtree
 			_heap[_root_index]._right = _heap[right]._right;
 			_heap[_root_index]._block_metadata._num_chunks +=
@@ -567,26 +1184,484 @@ bool SplayHeap::IterateHeap()
 			// Update root node statistics
 			UpdateNodeStatistics(_heap[_root_index]);
 
-#ifdef _DEBUG
-				SIMDMemSet(&_heap[_root_index + 1], MERGE_PATTERN, _heap[_root_index]._block_metadata._num_chunks - 1);
-#endif
+			if (DebugPolicy::FILL_PATTERNS)
+				SIMDMemSet(GetBlockData(_root_index), MERGE_PATTERN, GetBlockDataChunks(_root_index));
 		}
 		// Next block is allocated, fix up pointers
 		else
 			_heap[_root_index]._right = right;
 	}
 
+	// Index the moved free block now every debug fill of its payload is done
+	IndexFreeBlock(_root_index);
+
+	AssertHeapInvariants();
+
+	return _root_index;
+}
+template <typename Policies>
+void SplayHeapEngine<Policies>::SetDefragOnAllocateFailure(bool enable)
+{
+	_defrag_on_allocate_failure = enable;
+}
+
+template <typename Policies>
+DefragPlan SplayHeapEngine<Policies>::PlanDefrag(size_t num_bytes) const
+{
 	AssertHeapInvariants();
 
-	return IsFullyDefragmented( );
+	// Calculate the number of chunks an allocation of the given size needs
+	// A full compaction gathers every free chunk in the heap
+	const size_t mask = 16 - 1;
+	const auto offset = (16 - (num_bytes & mask)) & mask;
+	const auto required_chunks = num_bytes ? std::min<size_t>((num_bytes + offset) / 16 + _header_chunks, _free_chunks) : _free_chunks;
+
+	// An empty plan is already complete
+	if (!required_chunks)
+		return DefragPlan();
+
+	return PlanWindow(IndexType(required_chunks));
 }
-void SplayHeap::AssertHeapInvariants() const
+
+template <typename Policies>
+bool SplayHeapEngine<Policies>::IteratePlan(DefragPlan &plan)
+{
+	AssertHeapInvariants();
+
+	// Compaction walks the exact block structure
+	FoldWilderness();
+
+	// Find the first free block reaching into the window
+	// Splaying the start of the window leaves every later block in the right subtree
+	_root_index = Splay(plan._begin, _root_index);
+	auto free_block = _root_index;
+	if (_heap[free_block]._block_metadata._is_allocated ||
+		free_block + _heap[free_block]._block_metadata._num_chunks <= plan._begin)
+		free_block = FindFreeBlock(_heap[_root_index]._right, 1, FirstFitPolicy());
+
+	// Is the plan complete, or has the heap changed so nothing is left to slide in the window
+	if (free_block == NULL_INDEX || free_block >= plan._end)
+		return true;
+
+	if (_heap[free_block]._block_metadata._num_chunks >= plan._free_chunks ||
+		free_block + _heap[free_block]._block_metadata._num_chunks >= plan._end)
+		return true;
+
+	const auto moved_block = SlideRun(free_block);
+
+	return _heap[moved_block]._block_metadata._num_chunks >= plan._free_chunks;
+}
+
+template <typename Policies>
+HeapChunk* SplayHeapEngine<Policies>::CompactInto(HeapChunk* buffer, size_t num_threads)
+{
+	AssertHeapInvariants();
+	assert(buffer && buffer != _data && num_threads);
+
+	// Compaction walks the exact block structure
+	FoldWilderness();
+
+	// A contiguous part of the heap copied by one thread, starting at a run of allocated blocks
+	struct CompactPart
+	{
+		IndexType _index;
+		IndexType _new_index;
+	};
+
+	// Plan where each run of allocated blocks lands, the table lives in the new storage until the runs are copied over it
+	// Runs are separated by free blocks so there are never more of them than chunks
+	const IndexType first_block = SPLAY_HEADER_INDEX + 1;
+	const size_t live_chunks = _num_chunks - _free_chunks - first_block;
+	auto relocations = reinterpret_cast<PointerRelocation*>(buffer);
+	size_t num_relocations = 0;
+	std::vector<CompactPart> parts(1, CompactPart{ first_block, first_block });
+	IndexType new_index = first_block;
+	bool in_run = false;
+	for (IndexType index = first_block; index < _num_chunks; index += _heap[index]._block_metadata._num_chunks)
+	{
+		const auto &block = _heap[index];
+		if (!block._block_metadata._is_allocated)
+		{
+			// The free blocks are gathered into one at the end, drop them from the indices now
+			UnindexFreeBlock(index);
+			in_run = false;
+			continue;
+		}
+
+		if (!in_run)
+		{
+			// Start the next part once the current one holds its share of the live chunks
+			if (parts.size() < num_threads && (new_index - first_block) * num_threads >= parts.size() * live_chunks)
+				parts.push_back(CompactPart{ index, new_index });
+
+			relocations[num_relocations]._lower_bound = intptr_t(&_data[index]);
+			relocations[num_relocations]._offset = intptr_t(&buffer[new_index]) - intptr_t(&_data[index]);
+			num_relocations++;
+			in_run = true;
+		}
+
+		new_index += block._block_metadata._num_chunks;
+	}
+
+	assert(new_index + _free_chunks == _num_chunks);
+
+	// Update defraggable pointers before invalidating the heap, one pass for every run
+	_pointer_list.RelocatePointersInRange(&_data[first_block], &_data[_num_chunks], relocations, num_relocations);
+
+	/* CONSIDER THE HEAP INVALID FROM HERE */
+
+	// Copy the null sentinel and splay header, then stream the parts into place
+	// The new storage never overlaps the old, so the parts are copied concurrently in any order
+	SIMDMemCopy(buffer, _data, first_block);
+
+	std::vector<std::thread> threads;
+	threads.reserve(parts.size() - 1);
+	for (size_t i = 1; i < parts.size(); ++i)
+	{
+		const auto end = i + 1 < parts.size() ? parts[i + 1]._index : _num_chunks;
+		threads.emplace_back(&SplayHeapEngine::CopyRuns, this, buffer, parts[i]._index, end, parts[i]._new_index);
+	}
+
+	CopyRuns(buffer, first_block, parts.size() > 1 ? parts[1]._index : _num_chunks, first_block);
+
+	for (auto &thread : threads)
+		thread.join();
+
+	// Out of band headers stay in their array and are moved down in place, which never overwrites one not yet read
+	if (!_header_chunks)
+	{
+		IndexType new_header = first_block;
+		for (IndexType index = first_block; index < _num_chunks;)
+		{
+			const auto num_chunks = _heap[index]._block_metadata._num_chunks;
+			if (_heap[index]._block_metadata._is_allocated)
+			{
+				_heap[new_header] = _heap[index];
+				ChainVineNode(_heap[new_header], new_header);
+				new_header += num_chunks;
+			}
+
+			index += num_chunks;
+		}
+	}
+
+	// Adopt the new storage
+	const auto old_data = _data;
+	_data = buffer;
+	if (_header_chunks)
+		_heap = reinterpret_cast<SplayHeader*>(buffer);
+
+	// Gather the free chunks into one block ending the vine
+	if (_free_chunks)
+	{
+		new (&_heap[new_index]) SplayHeader(NULL_INDEX, NULL_INDEX, _free_chunks, FREE);
+		UpdateNodeStatistics(_heap[new_index]);
+
+		if (DebugPolicy::FILL_PATTERNS)
+			SIMDMemSet(GetBlockData(new_index), MOVE_PATTERN, GetBlockDataChunks(new_index));
+
+		// Index the free block, after the debug fill as a size index node lives in the payload
+		IndexFreeBlock(new_index);
+	}
+
+	/* HEAP IS NOW VALID */
+
+	_root_index = first_block;
+	_rover_index = new_index < _num_chunks ? new_index : first_block;
+
+	// The vine is already built, so the rebalance pass only walks it once and compresses it
+	_rebalance_phase = REBALANCE_START;
+	while (!Rebalance(_num_chunks))
+		;
+
+	AssertHeapInvariants();
+
+	return old_data;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::CopyRuns(HeapChunk* buffer, IndexType index, IndexType end, IndexType new_index)
+{
+	auto new_heap = reinterpret_cast<SplayHeader*>(buffer);
+	while (index < end)
+	{
+		if (!_heap[index]._block_metadata._is_allocated)
+		{
+			index += _heap[index]._block_metadata._num_chunks;
+			continue;
+		}
+
+		// Find the end of the run of allocated blocks
+		auto run_end = index;
+		while (run_end < end && _heap[run_end]._block_metadata._is_allocated)
+			run_end += _heap[run_end]._block_metadata._num_chunks;
+
+		SIMDMemCopy(&buffer[new_index], &_data[index], run_end - index);
+
+		// Inline headers moved along with their data, chain them in a single pass
+		if (!_header_chunks)
+		{
+			new_index += run_end - index;
+			index = run_end;
+			continue;
+		}
+
+		while (index < run_end)
+		{
+			const auto num_chunks = new_heap[new_index]._block_metadata._num_chunks;
+			ChainVineNode(new_heap[new_index], new_index);
+			index += num_chunks;
+			new_index += num_chunks;
+		}
+	}
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::ChainVineNode(SplayHeader &node, IndexType index) const
+{
+	// The free block ends the vine, so it is the largest free block below every node
+	const auto next = index + node._block_metadata._num_chunks;
+	node._left = NULL_INDEX;
+	node._right = next < _num_chunks ? next : NULL_INDEX;
+	node._max_contiguous_free_chunks = _free_chunks;
+}
+
+template <typename Policies>
+DefragPlan SplayHeapEngine<Policies>::PlanWindow(IndexType required_chunks) const
+{
+	assert(required_chunks && _free_chunks >= required_chunks);
+
+	// Slide a window of adjacent blocks over the heap, kept as short as possible while it holds
+	// enough free chunks, and remember the window with the fewest live chunks to move
+	const IndexType first_block = SPLAY_HEADER_INDEX + 1;
+	DefragPlan window(first_block, first_block);
+	DefragPlan plan(NULL_INDEX, NULL_INDEX);
+	plan._move_chunks = _num_chunks;
+	IndexType window_free_blocks = 0;
+	for (IndexType index = first_block; index < _num_chunks; index += _heap[index]._block_metadata._num_chunks)
+	{
+		const auto &block = _heap[index];
+		window._end = index + block._block_metadata._num_chunks;
+		if (block._block_metadata._is_allocated)
+		{
+			window._move_chunks += block._block_metadata._num_chunks;
+			window._move_blocks++;
+		}
+		else
+		{
+			window._free_chunks += block._block_metadata._num_chunks;
+			window_free_blocks++;
+		}
+
+		// Drop the blocks the window does not need off its front, so it always starts with a free block
+		while (window._begin != index)
+		{
+			const auto &front = _heap[window._begin];
+			if (front._block_metadata._is_allocated)
+			{
+				window._move_chunks -= front._block_metadata._num_chunks;
+				window._move_blocks--;
+			}
+			else if (window._free_chunks - front._block_metadata._num_chunks >= required_chunks)
+			{
+				window._free_chunks -= front._block_metadata._num_chunks;
+				window_free_blocks--;
+			}
+			else
+				break;
+
+			window._begin += front._block_metadata._num_chunks;
+		}
+
+		if (window._free_chunks >= required_chunks && window._move_chunks < plan._move_chunks)
+		{
+			// Free blocks and runs of allocated blocks alternate, each run between two free blocks slides once
+			plan = window;
+			plan._move_runs = window_free_blocks - 1;
+		}
+	}
+
+	assert(plan._begin != NULL_INDEX);
+
+	return plan;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::DefragForAllocation(IndexType required_chunks)
+{
+	// Carry out the cheapest plan that gathers enough free chunks in one go
+	auto plan = PlanWindow(required_chunks);
+	while (!IteratePlan(plan))
+		;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::FullDefragFromTop()
+{
+	AssertHeapInvariants();
+	while (!IterateHeapFromTop())
+		;
+	AssertHeapInvariants();
+}
+
+template <typename Policies>
+bool SplayHeapEngine<Policies>::IterateHeapFromTop()
+{
+	AssertHeapInvariants();
+	// Do we actually need to defrag the heap
+	if (IsFullyDefragmented())
+		return true;
+
+	// Compaction walks the exact block structure
+	FoldWilderness();
+
+	// Find the lowest hole in the heap
+	const auto free_block = FindFreeBlock(_root_index, 1, FirstFitPolicy());
+	const auto free_chunks = _heap[free_block]._block_metadata._num_chunks;
+
+	// Find the last block in the heap, the maximum of the tree
+	IndexType index = _root_index;
+	while (_heap[index]._right)
+		index = _heap[index]._right;
+
+	// Walk down from the top of the heap to the highest allocated block that fits the hole
+	// An exact fit further down is worth the extra steps as it leaves no sliver of a hole behind
+	// Splaying each block in descending order keeps the walk linear overall
+	IndexType move_block = NULL_INDEX;
+	IndexType search_blocks = TOP_FIT_SEARCH_BLOCKS;
+	while (index > free_block && search_blocks--)
+	{
+		_root_index = Splay(index, _root_index);
+
+		const auto &block = _heap[index];
+		if (block._block_metadata._is_allocated && block._block_metadata._num_chunks <= free_chunks)
+		{
+			if (move_block == NULL_INDEX || block._block_metadata._num_chunks == free_chunks)
+				move_block = index;
+
+			if (block._block_metadata._num_chunks == free_chunks)
+				break;
+		}
+
+		// The previous block is the maximum of the left subtree
+		index = block._left;
+		while (_heap[index]._right)
+			index = _heap[index]._right;
+	}
+
+	// No block above fits the hole, slide the blocks after it down instead
+	if (move_block == NULL_INDEX)
+		return IterateHeap();
+
+	// Update defraggable pointers before invalidating the heap
+	const auto move_chunks = _heap[move_block]._block_metadata._num_chunks;
+	_pointer_list.OffsetPointersInRange(&_data[move_block], &_data[move_block + move_chunks], (ptrdiff_t(free_block) - ptrdiff_t(move_block)) * 16);
+
+	// Splay the hole to the root and allocate it to the block
+	_root_index = Splay(free_block, _root_index);
+	UnindexFreeBlock(free_block);
+	AllocateRootBlock(move_chunks);
+
+	// Move the data, the hole and the block never overlap
+	SIMDMemCopy(GetBlockData(free_block), GetBlockData(move_block), GetBlockDataChunks(free_block));
+
+	// Release the old block, merging it with its free neighbours
+	FreeBlock(move_block);
+
+	return IsFullyDefragmented();
+}
+
+template <typename Policies>
+bool SplayHeapEngine<Policies>::Rebalance(size_t budget)
+{
+	AssertHeapInvariants();
+
+	// Start a new pass over the whole tree
+	if (_rebalance_phase == REBALANCE_START)
+	{
+		// Fold the wilderness now so a later free does not pay for it
+		FoldWilderness();
+
+		// The splay header is the pseudo root the vine hangs off
+		new (&_heap[SPLAY_HEADER_INDEX]) SplayHeader(NULL_INDEX, _root_index, 1, ALLOCATED);
+		_rebalance_phase = REBALANCE_VINE;
+		_rebalance_cursor = SPLAY_HEADER_INDEX;
+		_rebalance_size = 0;
+	}
+
+	assert(_heap[SPLAY_HEADER_INDEX]._right == _root_index);
+
+	// Rotations inside a subtree keep its maximum so the statistics stay valid after every step
+	for (; budget && _rebalance_phase != REBALANCE_DONE; --budget)
+	{
+		auto &cursor = _heap[_rebalance_cursor];
+
+		if (_rebalance_phase == REBALANCE_VINE)
+		{
+			const auto rest = cursor._right;
+
+			// Rotate left children up until the rest of the tree is a right leaning vine
+			if (_heap[rest]._left)
+				cursor._right = RotateWithLeftChild(rest);
+			// Advance down the vine
+			else if (rest)
+			{
+				_rebalance_cursor = rest;
+				++_rebalance_size;
+			}
+			// The vine is complete, the first compression leaves a full tree over the remaining nodes
+			else
+			{
+				IndexType full_size = 1;
+				while (full_size * 2 <= _rebalance_size + 1)
+					full_size *= 2;
+
+				_rebalance_phase = REBALANCE_COMPRESS;
+				_rebalance_cursor = SPLAY_HEADER_INDEX;
+				_rebalance_rotations = _rebalance_size + 1 - full_size;
+				_rebalance_size -= _rebalance_rotations;
+			}
+		}
+		else
+		{
+			// Rotate every other vine node down to the left
+			if (_rebalance_rotations)
+			{
+				cursor._right = RotateWithRightChild(cursor._right);
+				_rebalance_cursor = cursor._right;
+				--_rebalance_rotations;
+			}
+			// Each later compression halves the vine
+			else if (_rebalance_size > 1)
+			{
+				_rebalance_size /= 2;
+				_rebalance_rotations = _rebalance_size;
+				_rebalance_cursor = SPLAY_HEADER_INDEX;
+			}
+			else
+				_rebalance_phase = REBALANCE_DONE;
+		}
+	}
+
+	_root_index = _heap[SPLAY_HEADER_INDEX]._right;
+
+	AssertHeapInvariants();
+
+	return _rebalance_phase == REBALANCE_DONE;
+}
+
+template <typename Policies>
+void SplayHeapEngine<Policies>::AssertHeapInvariants() const
 {
 #ifdef NDEBUG
 	// We don't want to call this in release code
 	return;
 #endif
 
+	// The debug policy may opt out of invariant checking
+	if (!DebugPolicy::CHECK_INVARIANTS)
+		return;
+
 	/**
 	*	Splay heap uses a null sentinel node to simplify some heap operations.
 	*/
@@ -691,8 +1766,8 @@ void SplayHeap::AssertHeapInvariants() const
 				// Do we have more nodes to visit
 				if (!tree.empty())
 				{
-					// We should be still inside the heap
-					assert(current < _num_chunks);
+					// We should be still inside the tree managed part of the heap
+					assert(current < _wilderness_index);
 
 					// Visit last node on stack
 					node = tree.back();
@@ -714,13 +1789,39 @@ void SplayHeap::AssertHeapInvariants() const
 			}
 		}
 
-		// We should be at the end of the heap
-		assert(current == _num_chunks);
+		// We should be at the start of the wilderness
+		assert(current == _wilderness_index);
+	}
+
+	/**
+	*	Splay heap can detach the trailing free block as a wilderness. It holds bump allocated blocks followed by at most one free block.
+	*/
+	{
+		assert(_wilderness_index <= _bump_index);
+		assert(_bump_index <= _num_chunks);
+
+		// Blocks below the bump index are allocated
+		IndexType current = _wilderness_index;
+		while (current < _bump_index)
+		{
+			assert(_heap[current]._block_metadata._is_allocated);
+			current += _heap[current]._block_metadata._num_chunks;
+		}
+
+		// The remaining wilderness is a single free block
+		assert(current == _bump_index);
+		if (_bump_index < _num_chunks)
+		{
+			assert(!_heap[_bump_index]._block_metadata._is_allocated);
+			assert(_bump_index + _heap[_bump_index]._block_metadata._num_chunks == _num_chunks);
+		}
 	}
 
 	/**
 	*	Splay heap uses a max contiguous free chunk tree statistic to speed up searching. This maximum must be valid at all tree levels. 
+	*	The tree may be empty while the whole heap is in the wilderness.
 	*/
+	if (_root_index != NULL_INDEX)
 	{
 		// Push root node onto the tracking stack
 		std::deque<IndexType> tree;
@@ -807,4 +1908,80 @@ void SplayHeap::AssertHeapInvariants() const
 		assert(!max.empty());
 		assert(_heap[_root_index]._max_contiguous_free_chunks == max.back());
 	}
+
+	/**
+	*	Best fit policies keep a size index of the free blocks in the tree. An inorder traversal should visit 
+	*	every free block with a payload chunk exactly once, ordered by size then address.
+	*/
+	if (FitPolicy::BEST_FIT)
+	{
+		// Count the free blocks the index should hold
+		IndexType expected = 0;
+		for (IndexType index = 2; index < _wilderness_index; index += _heap[index]._block_metadata._num_chunks)
+		{
+			if (!_heap[index]._block_metadata._is_allocated && GetBlockDataChunks(index))
+				++expected;
+		}
+
+		// Perform inorder traversal
+		std::deque<IndexType> tree;
+		IndexType node = _size_root_index;
+		IndexType prev = NULL_INDEX;
+		IndexType visited = 0;
+		while (node || !tree.empty())
+		{
+			if (node)
+			{
+				tree.push_back(node);
+				node = GetSizeIndexNode(node)._left;
+				continue;
+			}
+
+			node = tree.back();
+			tree.pop_back();
+
+			// Assert the node indexes a free block in the tree with its current size
+			const auto &n = GetSizeIndexNode(node);
+			assert(node < _wilderness_index);
+			assert(!_heap[node]._block_metadata._is_allocated);
+			assert(GetBlockDataChunks(node));
+			assert(n._num_chunks == _heap[node]._block_metadata._num_chunks);
+
+			// Assert the keys are strictly increasing
+			if (prev)
+			{
+				const auto &p = GetSizeIndexNode(prev);
+				assert(p._num_chunks < n._num_chunks || (p._num_chunks == n._num_chunks && prev < node));
+			}
+
+			prev = node;
+			++visited;
+			node = n._right;
+		}
+
+		assert(visited == expected);
+	}
+
+	/**
+	*	Indexed policies keep every free block in the tree in the free block index with its current size.
+	*/
+	if (FitPolicy::INDEXED)
+	{
+		IndexType expected = 0;
+		for (IndexType index = 2; index < _wilderness_index; index += _heap[index]._block_metadata._num_chunks)
+		{
+			const auto &n = _heap[index];
+			if (n._block_metadata._is_allocated)
+				continue;
+
+			assert(_free_index.GetNumChunks(index) == n._block_metadata._num_chunks);
+			++expected;
+		}
+
+		assert(_free_index.GetCount() == expected);
+		_free_index.AssertInvariants();
+	}
 }
+
+// Instantiate the engine for the supported policy combinations
+INSTANTIATE_HEAP_ENGINE(SplayHeapEngine)
\ No newline at end of file
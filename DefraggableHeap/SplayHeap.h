@@ -26,30 +26,48 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include "BasicDefraggableHeap.h"
 #include "DefraggablePointerList.h"
+#include "FreeBlockIndex.h"
+#include "PackedFreeBlockIndex.h"
 #include "HeapCommon.h"
+#include "HeapPolicies.h"
+
+#include <type_traits>
 
 struct SplayHeader;
+struct SizeIndexNode;
+class GenerationalHeap;
 
 /**
-*	A defraggable heap implemented as a splay tree.
+*	A defraggable heap engine implemented as a splay tree.
+*
+*	@tparam Policies the HeapPolicies bundle the engine is compiled for
 */
-class SplayHeap final
+template <typename Policies>
+class SplayHeapEngine
 {
+	/**< Generational heaps share the pointer list of their old generation. */
+	friend class GenerationalHeap;
 
 public:
 
+	typedef typename Policies::FitPolicy FitPolicy;
+	typedef typename Policies::PointerPolicy PointerPolicy;
+	typedef typename Policies::DebugPolicy DebugPolicy;
+
 	/**
 	*	Constructs a splay heap.
 	*
 	*	@param size the size of the heap in bytes.
+	*	@param layout where the block headers should be stored
 	*/
-	SplayHeap(size_t size);
+	SplayHeapEngine(size_t size, HeaderLayout layout = INLINE_HEADERS);
 
 	/**
 	*	Destroys a splay heap.
 	*/
-	~SplayHeap();
+	~SplayHeapEngine();
 
 	/**
 	*	Allocates from the splay heap. Always 16 byte aligned.
@@ -59,9 +77,20 @@ public:
 	*/
 	DefraggablePointerControlBlock Allocate(size_t num_bytes);
 
+	/**
+	*	Allocates from the splay heap, placing the block by how long it is expected to live. Always 16 byte aligned.
+	*	Long lived blocks are placed by the fit policy, short lived ones off the top of the highest free block that fits.
+	*
+	*	@param num_bytes the number of bytes to allocated
+	*	@param hint how long the block is expected to live
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock Allocate(size_t num_bytes, LifetimeHint hint);
+
 	/**
 	*	Frees the given heap data. Invalidates all defraggable pointers
-	*	pointing into the free block.
+	*	pointing into the free block, or only the given pointer if the 
+	*	pointer policy does not track aliases.
 	*
 	*	@param ptr pointer into block in heap to free
 	*/
@@ -80,6 +109,60 @@ public:
 	*/
 	bool IterateHeap();
 
+	/**
+	*	Fully defragments the heap by filling holes from the top of the heap.
+	*/
+	void FullDefragFromTop();
+
+	/**
+	*	Iterates the two finger defragmentation process on the heap.
+	*	Fills the lowest hole with a block from the top of the heap that fits it, so the
+	*	bytes moved scale with the fragmentation rather than the live data above the hole.
+	*	Slides the blocks after the hole down when none of them fit.
+	*	Heap is still valid for use after a call to this method.
+	*
+	*	@returns true if the heap is now fully defragmented
+	*/
+	bool IterateHeapFromTop();
+
+	/**
+	*	Sets if an allocation that finds no free block large enough should compact the cheapest
+	*	window of blocks holding enough free space and retry, instead of failing.
+	*
+	*	@param enable true to make room for failed allocations
+	*/
+	void SetDefragOnAllocateFailure(bool enable);
+
+	/**
+	*	Plans the cheapest compaction that makes room for an allocation of the given size, without moving anything.
+	*	The plan compacts the whole heap if the size is 0 or more than the heap has free.
+	*
+	*	@param num_bytes the size of the allocation to make room for
+	*	@returns the plan and its cost
+	*/
+	DefragPlan PlanDefrag(size_t num_bytes = 0) const;
+
+	/**
+	*	Iterates the given plan, sliding one run of allocated blocks in its window down.
+	*	Heap is still valid for use after a call to this method.
+	*
+	*	@param plan the plan made by this heap
+	*	@returns true if the plan is complete
+	*/
+	bool IteratePlan(DefragPlan &plan);
+
+	/**
+	*	Fully defragments the heap by copying the allocated blocks in address order into the given storage,
+	*	which the heap then adopts. Each byte of live data is copied once, unlike sliding it down in place,
+	*	and the tree is rebuilt balanced.
+	*	The copy is split into parts holding an even share of the live data, each copied on its own thread.
+	*
+	*	@param buffer storage for at least the size of the heap, allocated with AlignedNew 16 byte aligned
+	*	@param num_threads the number of threads copying the heap, including the calling thread
+	*	@returns the storage the heap used before, for the next compaction or AlignedDelete
+	*/
+	HeapChunk* CompactInto(HeapChunk* buffer, size_t num_threads = 1);
+
 	/**
 	*	Gets the fragmentation ratio of the heap.
 	*
@@ -94,16 +177,234 @@ public:
 	*/
 	bool IsFullyDefragmented() const;
 
+	/**
+	*	Rebalances the tree towards a complete binary tree with a Day-Stout-Warren pass.
+	*	The pass is spread over calls by the budget, any splay in between restarts it.
+	*
+	*	@param budget the maximum number of rotations and vine steps to perform
+	*	@returns true if the tree is now balanced
+	*/
+	bool Rebalance(size_t budget);
+
 protected:
 
 	/**
-	*	Finds a free heap block of desired size.
+	*	The phases of an incremental rebalance pass.
+	*/
+	enum RebalancePhase
+	{
+		REBALANCE_START, REBALANCE_VINE, REBALANCE_COMPRESS, REBALANCE_DONE
+	};
+
+	/**
+	*	Allocates a block of the given number of chunks, including the header.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunks(IndexType required_chunks);
+
+	/**
+	*	Allocates a block of the given number of chunks, including the header, off the top of the highest free block that fits.
+	*	Folds the wilderness back into the tree so the top of the heap is searched first.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock AllocateChunksFromTop(IndexType required_chunks);
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size.
 	*
 	*	@param t the node to start the search at
 	*	@param num_chunks the minimum number of chunks required in the free block
 	*	@returns the free block
 	*/
-	IndexType FindFreeBlock( IndexType t, IndexType num_chunks ) const;
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, FirstFitPolicy ) const;
+
+	/**
+	*	Finds the first free heap block of desired size after the rover, wrapping around
+	*	to the start of the heap. Splays the rover to the root of the tree.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, NextFitPolicy );
+
+	/**
+	*	Finds the smallest free heap block of desired size in the tree, breaking ties on the lowest address.
+	*	Splays the found block to the root of the size index.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, BestFitPolicy );
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size in the free block index.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, IndexedFirstFitPolicy ) const;
+
+	/**
+	*	Finds the lowest addressed free heap block of desired size in the packed free block index.
+	*
+	*	@param t the root of the tree
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindFreeBlock( IndexType t, IndexType num_chunks, PackedFirstFitPolicy ) const;
+
+	/**
+	*	Finds the highest addressed free heap block of desired size, searching right subtrees first.
+	*
+	*	@param t the node to start the search at
+	*	@param num_chunks the minimum number of chunks required in the free block
+	*	@returns the free block
+	*/
+	IndexType FindLastFreeBlock( IndexType t, IndexType num_chunks ) const;
+
+	/**
+	*	Adds the given free block of the tree to the indices the fit policy keeps.
+	*
+	*	@param index the index of the free block
+	*/
+	void IndexFreeBlock(IndexType index);
+
+	/**
+	*	Removes the given free block of the tree from the indices the fit policy keeps.
+	*	Must be called before the block header or payload is changed.
+	*
+	*	@param index the index of the free block
+	*/
+	void UnindexFreeBlock(IndexType index);
+
+	/**
+	*	Inserts the given free block into the size index if it has room for an index node.
+	*
+	*	@param index the index of the free block
+	*/
+	void InsertSizeIndex(IndexType index);
+
+	/**
+	*	Removes the given free block from the size index if it has room for an index node.
+	*	Must be called before the block header or payload is changed.
+	*
+	*	@param index the index of the free block
+	*/
+	void RemoveSizeIndex(IndexType index);
+
+	/**
+	*	Splays the node with the given key, or the last node on its search path, to the root of a size index subtree.
+	*
+	*	@param num_chunks the size part of the key
+	*	@param index the address part of the key
+	*	@param t the node to start the splay from
+	*	@returns the new root of the subtree
+	*/
+	IndexType SplaySizeIndex(IndexType num_chunks, IndexType index, IndexType t);
+
+	/**
+	*	Gets the size index node stored in the payload of the given free block.
+	*
+	*	@param index the index of the free block
+	*	@returns the size index node
+	*/
+	SizeIndexNode& GetSizeIndexNode(IndexType index) const;
+
+	/**
+	*	Bump allocates a block off the front of the detached wilderness.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the pointer to allocated memory
+	*/
+	DefraggablePointerControlBlock BumpAllocate(IndexType required_chunks);
+
+	/**
+	*	Slides the run of allocated blocks after the given free block down over it,
+	*	merging the moved free block with the next free block.
+	*
+	*	@param free_block the index of the free block
+	*	@returns the index of the moved free block
+	*/
+	IndexType SlideRun(IndexType free_block);
+
+	/**
+	*	Finds the window of adjacent blocks holding enough free chunks that moves the fewest live chunks.
+	*
+	*	@param required_chunks the number of free chunks the window needs
+	*	@returns the plan compacting the window
+	*/
+	DefragPlan PlanWindow(IndexType required_chunks) const;
+
+	/**
+	*	Makes room for an allocation by carrying out the cheapest plan for it.
+	*
+	*	@param required_chunks the number of chunks the allocation needs
+	*/
+	void DefragForAllocation(IndexType required_chunks);
+
+	/**
+	*	Copies the runs of allocated blocks in the given part of the heap back to back into new storage.
+	*	Inline headers are chained in the new storage, out of band headers are left for the caller to move.
+	*
+	*	@param buffer the new storage
+	*	@param index the index of the first block in the part
+	*	@param end the index after the last block in the part
+	*	@param new_index the index the first allocated block lands at
+	*/
+	void CopyRuns(HeapChunk* buffer, IndexType index, IndexType end, IndexType new_index);
+
+	/**
+	*	Links a compacted allocated block into the right leaning vine of blocks in address order.
+	*
+	*	@param node the header of the block
+	*	@param index the index of the block
+	*/
+	void ChainVineNode(SplayHeader &node, IndexType index) const;
+
+	/**
+	*	Allocates the front of the free block at the root, splitting off any remaining chunks.
+	*	The root must already be removed from the free block indices.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the index of the allocated block
+	*/
+	IndexType AllocateRootBlock(IndexType required_chunks);
+
+	/**
+	*	Allocates the back of the free block at the root, shrinking it in place to any remaining chunks.
+	*	The root must already be removed from the free block indices.
+	*
+	*	@param required_chunks the number of chunks the block needs
+	*	@returns the index of the allocated block
+	*/
+	IndexType AllocateRootBlockFromTop(IndexType required_chunks);
+
+	/**
+	*	Frees the given allocated block, merging it with its free neighbours.
+	*	Defraggable pointers into the block must already be invalidated or moved.
+	*
+	*	@param index the index of the allocated block
+	*/
+	void FreeBlock(IndexType index);
+
+	/**
+	*	Inserts the blocks of a detached wilderness back into the tree.
+	*/
+	void FoldWilderness();
+
+	/**
+	*	Gets the largest number of contiguous free chunks in the tree or wilderness.
+	*
+	*	@returns the size of the largest free block
+	*/
+	IndexType GetMaxContiguousFreeChunks() const;
 
 	/**
 	*	Splays the given value to the root of the tree.
@@ -136,14 +437,36 @@ protected:
 	*/
 	IndexType RotateWithRightChild(IndexType k1);
 
+	/**
+	*	Gets the payload address of the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the address of the first payload chunk
+	*/
+	HeapChunk* GetBlockData(IndexType index) const;
+
+	/**
+	*	Gets the number of payload chunks in the given block.
+	*
+	*	@param index the index of the block
+	*	@returns the number of chunks not used by the block header
+	*/
+	IndexType GetBlockDataChunks(IndexType index) const;
+
 	/**
 	*	Asserts invariants over the heap.
 	*/
 	void AssertHeapInvariants() const;
 
-	/**< The data heap we manage. */
+	/**< The block headers we manage, indexed by chunk. */
 	SplayHeader* _heap;
 
+	/**< The payload chunks we manage. Aliases the headers when they are stored inline. */
+	HeapChunk* _data;
+
+	/**< The number of chunks each block spends on its header. */
+	IndexType _header_chunks;
+
 	/**< The number of chunks in the heap. */
 	IndexType _num_chunks;
 
@@ -153,12 +476,53 @@ protected:
 	/**< The total number of free chunks in the heap. */
 	IndexType _free_chunks;
 
+	/**< The first block of the detached wilderness, the number of chunks if the wilderness is in the tree. */
+	IndexType _wilderness_index;
+
+	/**< The free block at the end of the wilderness we bump allocate from. */
+	IndexType _bump_index;
+
+	/**< The end of the last allocation, where roving fit policies start searching. */
+	IndexType _rover_index;
+
+	/**< Should a failed allocation compact a window of the heap and retry. */
+	bool _defrag_on_allocate_failure;
+
+	/**< The phase of the current rebalance pass. */
+	RebalancePhase _rebalance_phase;
+
+	/**< The vine node the next rebalance step works below. */
+	IndexType _rebalance_cursor;
+
+	/**< The number of vine nodes counted, then the number of vine nodes left to compress. */
+	IndexType _rebalance_size;
+
+	/**< The number of rotations left in the current compression of the vine. */
+	IndexType _rebalance_rotations;
+
+	/**< The root of the size index of free blocks, only maintained by best fit policies. */
+	IndexType _size_root_index;
+
+	/**< The type of free block index the fit policy searches. */
+	typedef typename std::conditional<FitPolicy::PACKED, PackedFreeBlockIndex, FreeBlockIndex>::type FreeIndex;
+
+	/**< The address ordered index of free blocks, only maintained by indexed policies. */
+	FreeIndex _free_index;
+
 	/**< The list of defraggable pointers for this heap. */
 	DefraggablePointerList _pointer_list;
 
 	/**< The offset of the null sentinel node into the heap. */
 	static const IndexType NULL_INDEX = 0;
 
+	/**< The number of blocks below the top of the heap searched for one that fits the hole being filled. */
+	static const IndexType TOP_FIT_SEARCH_BLOCKS = 64;
+
 	/**< The offset of the splay header node into the heap. */
 	static const IndexType SPLAY_HEADER_INDEX = 1;
-};
\ No newline at end of file
+};
+
+/**
+*	A defraggable heap implemented as a splay tree with the default policies.
+*/
+typedef BasicDefraggableHeap<SplayHeapEngine> SplayHeap;
\ No newline at end of file